@@ -0,0 +1,292 @@
+#pragma once
+
+// A search backend for small exact cover problems, which keeps the live options and the uncovered items as bitsets
+// instead of linked lists.
+// Every option has a precalculated bitset of the options it conflicts with, which are the options that share an
+// item with it. Taking an option is then an AND NOT of that bitset into the live options, and counting the options
+// of an item is a popcount of an AND. There is a copy of the bitsets per level, so backtracking doesn't undo anything.
+// The word loops are plain uint64_t code with std::popcount, not AVX2 intrinsics. The models this is for have a few
+// words per bitset (NQueens(13) has 169 options, which is 3 words), which is less than one AVX2 register, so this
+// stays portable and leaves vectorizing the longer loops to the compiler.
+// This doesn't support colors or multiplicities, only items that are covered once (primary) or at most once (secondary).
+// Solver::Solve uses it automatically when the model fits and USE_BIT_SOLVER() is true.
+class BitSolver
+{
+public:
+    static const int c_maxItems = 1024;
+    static const int c_maxOptions = 4096;
+
+    static bool Fits(int itemCount, int optionCount)
+    {
+        return itemCount <= c_maxItems && optionCount <= c_maxOptions;
+    }
+
+    // Make room for the items and options. Items before firstOptionalItem are primary, the rest are secondary.
+    void Init(int itemCount, int firstOptionalItem, int optionCount)
+    {
+        m_itemCount = itemCount;
+        m_firstOptionalItem = firstOptionalItem;
+        m_optionCount = optionCount;
+        m_itemWords = (itemCount + 63) / 64;
+        m_optionWords = (optionCount + 63) / 64;
+
+        m_itemOptions.assign(size_t(itemCount) * m_optionWords, 0);
+        m_optionItems.assign(size_t(optionCount) * m_itemWords, 0);
+
+        m_primaryItems.assign(m_itemWords, 0);
+        for (int itemIndex = 0; itemIndex < firstOptionalItem; ++itemIndex)
+            m_primaryItems[itemIndex / 64] |= uint64_t(1) << (itemIndex % 64);
+    }
+
+    void AddOptionItem(int optionIndex, int itemIndex)
+    {
+        m_itemOptions[size_t(itemIndex) * m_optionWords + optionIndex / 64] |= uint64_t(1) << (optionIndex % 64);
+        m_optionItems[size_t(optionIndex) * m_itemWords + itemIndex / 64] |= uint64_t(1) << (itemIndex % 64);
+    }
+
+    // Calls solutionLambda(*this) for each solution, with SolutionOptions() in the order they were chosen.
+    // Items are chosen and options are tried in the same order as Solver does, so the search tree is the same.
+    // Calls progressLambda(*this) every PRINT_PROGRESS_RATE() options tried, for it to show how far along the search is.
+    template <typename TSolutionLambdaFN, typename TProgressLambdaFN>
+    void Solve(const TSolutionLambdaFN& solutionLambda, const TProgressLambdaFN& progressLambda)
+    {
+        MakeOptionConflicts();
+
+        // Every item takes at least one level, plus one for the solution
+        int maxLevels = m_firstOptionalItem + 1;
+        m_levelLiveOptions.assign(size_t(maxLevels) * m_optionWords, 0);
+        m_levelUncoveredItems.assign(size_t(maxLevels) * m_itemWords, 0);
+        m_levelItemIndices.assign(maxLevels, -1);
+        m_levelOptionIndices.assign(maxLevels, -1);
+        m_levelOptionNumbers.assign(maxLevels, 0);
+        m_levelBranchCounts.assign(maxLevels, 0);
+        m_solutionOptionIndices.reserve(maxLevels);
+
+        for (int optionIndex = 0; optionIndex < m_optionCount; ++optionIndex)
+            m_levelLiveOptions[optionIndex / 64] |= uint64_t(1) << (optionIndex % 64);
+        for (int itemIndex = 0; itemIndex < m_itemCount; ++itemIndex)
+            m_levelUncoveredItems[itemIndex / 64] |= uint64_t(1) << (itemIndex % 64);
+
+        enum class SearchState
+        {
+            EnterLevel,
+            TryOption,
+            LeaveLevel,
+            Done
+        };
+
+        m_level = 0;
+        int& level = m_level;
+        SearchState searchState = SearchState::EnterLevel;
+        while (searchState != SearchState::Done)
+        {
+            switch (searchState)
+            {
+                // Report a solution, or choose an item to try options for
+                case SearchState::EnterLevel:
+                {
+                    m_maxRecursionDepth = std::max(m_maxRecursionDepth, level);
+
+                    int chosenItemIndex = -1;
+                    int chosenOptionCount = 0;
+                    if (!ChooseItem(level, chosenItemIndex, chosenOptionCount))
+                    {
+                        m_solutionOptionIndices.assign(m_levelOptionIndices.begin(), m_levelOptionIndices.begin() + level);
+                        m_solutionsFound++;
+                        searchState = SearchState::LeaveLevel;
+                        solutionLambda(*this);
+                        break;
+                    }
+
+                    if (chosenItemIndex < 0)
+                    {
+                        searchState = SearchState::LeaveLevel;
+                        break;
+                    }
+
+                    m_levelItemIndices[level] = chosenItemIndex;
+                    m_levelOptionIndices[level] = -1;
+                    m_levelOptionNumbers[level] = -1;
+                    m_levelBranchCounts[level] = chosenOptionCount;
+                    searchState = SearchState::TryOption;
+                    break;
+                }
+
+                // Take the next live option of this level's item, making the bitsets for the level below
+                case SearchState::TryOption:
+                {
+                    int optionIndex = NextOption(level);
+                    if (optionIndex < 0)
+                    {
+                        searchState = SearchState::LeaveLevel;
+                        break;
+                    }
+
+                    m_levelOptionIndices[level] = optionIndex;
+                    m_levelOptionNumbers[level]++;
+                    m_attempts++;
+                    if ((m_attempts % PRINT_PROGRESS_RATE()) == 0)
+                        progressLambda(*this);
+
+                    const uint64_t* liveOptions = &m_levelLiveOptions[size_t(level) * m_optionWords];
+                    const uint64_t* conflicts = &m_optionConflicts[size_t(optionIndex) * m_optionWords];
+                    uint64_t* nextLiveOptions = &m_levelLiveOptions[size_t(level + 1) * m_optionWords];
+                    for (int word = 0; word < m_optionWords; ++word)
+                        nextLiveOptions[word] = liveOptions[word] & ~conflicts[word];
+
+                    const uint64_t* uncoveredItems = &m_levelUncoveredItems[size_t(level) * m_itemWords];
+                    const uint64_t* optionItems = &m_optionItems[size_t(optionIndex) * m_itemWords];
+                    uint64_t* nextUncoveredItems = &m_levelUncoveredItems[size_t(level + 1) * m_itemWords];
+                    for (int word = 0; word < m_itemWords; ++word)
+                        nextUncoveredItems[word] = uncoveredItems[word] & ~optionItems[word];
+
+                    level++;
+                    searchState = SearchState::EnterLevel;
+                    break;
+                }
+
+                case SearchState::LeaveLevel:
+                {
+                    if (level == 0)
+                    {
+                        searchState = SearchState::Done;
+                        break;
+                    }
+
+                    level--;
+                    searchState = SearchState::TryOption;
+                    break;
+                }
+
+                // The loop ends before getting here
+                case SearchState::Done:
+                    break;
+            }
+        }
+    }
+
+    // The option indices of the current solution, in the order they were chosen
+    std::span<const int> SolutionOptions() const
+    {
+        return m_solutionOptionIndices;
+    }
+
+    // Where the search is: the option number being tried at each level down to the current one, out of how many
+    // options that level's item had when it was chosen
+    std::span<const int> LevelOptionNumbers() const
+    {
+        return std::span<const int>(m_levelOptionNumbers.data(), m_level + 1);
+    }
+
+    std::span<const int> LevelBranchCounts() const
+    {
+        return std::span<const int>(m_levelBranchCounts.data(), m_level + 1);
+    }
+
+    size_t m_solutionsFound = 0;
+    size_t m_attempts = 0;
+    int m_maxRecursionDepth = 0;
+
+private:
+    // An option conflicts with every option that shares an item with it, including itself
+    void MakeOptionConflicts()
+    {
+        m_optionConflicts.assign(size_t(m_optionCount) * m_optionWords, 0);
+        for (int optionIndex = 0; optionIndex < m_optionCount; ++optionIndex)
+        {
+            uint64_t* conflicts = &m_optionConflicts[size_t(optionIndex) * m_optionWords];
+            const uint64_t* optionItems = &m_optionItems[size_t(optionIndex) * m_itemWords];
+            for (int itemWord = 0; itemWord < m_itemWords; ++itemWord)
+            {
+                for (uint64_t bits = optionItems[itemWord]; bits; bits &= bits - 1)
+                {
+                    int itemIndex = itemWord * 64 + std::countr_zero(bits);
+                    const uint64_t* itemOptions = &m_itemOptions[size_t(itemIndex) * m_optionWords];
+                    for (int word = 0; word < m_optionWords; ++word)
+                        conflicts[word] |= itemOptions[word];
+                }
+            }
+        }
+    }
+
+    // Returns false if there are no primary items left to cover, which means this level is a solution.
+    // Otherwise chosenItemIndex is the first uncovered primary item with the fewest live options,
+    // or -1 if some item has no live options left, and chosenOptionCount is how many live options it has.
+    bool ChooseItem(int level, int& chosenItemIndex, int& chosenOptionCount) const
+    {
+        const uint64_t* liveOptions = &m_levelLiveOptions[size_t(level) * m_optionWords];
+        const uint64_t* uncoveredItems = &m_levelUncoveredItems[size_t(level) * m_itemWords];
+
+        bool anyUncovered = false;
+        int lowestOptionCount = std::numeric_limits<int>::max();
+        for (int itemWord = 0; itemWord < m_itemWords; ++itemWord)
+        {
+            for (uint64_t bits = uncoveredItems[itemWord] & m_primaryItems[itemWord]; bits; bits &= bits - 1)
+            {
+                anyUncovered = true;
+                int itemIndex = itemWord * 64 + std::countr_zero(bits);
+                const uint64_t* itemOptions = &m_itemOptions[size_t(itemIndex) * m_optionWords];
+
+                int optionCount = 0;
+                for (int word = 0; word < m_optionWords; ++word)
+                    optionCount += std::popcount(liveOptions[word] & itemOptions[word]);
+
+                if (optionCount < lowestOptionCount)
+                {
+                    lowestOptionCount = optionCount;
+                    chosenItemIndex = itemIndex;
+                    chosenOptionCount = optionCount;
+
+                    // Nothing can be lower, and the search needs to backtrack
+                    if (optionCount == 0)
+                    {
+                        chosenItemIndex = -1;
+                        return true;
+                    }
+                }
+            }
+        }
+
+        return anyUncovered;
+    }
+
+    // Get the next live option of this level's item after the one last tried, or -1 if there are no more
+    int NextOption(int level) const
+    {
+        const uint64_t* liveOptions = &m_levelLiveOptions[size_t(level) * m_optionWords];
+        const uint64_t* itemOptions = &m_itemOptions[size_t(m_levelItemIndices[level]) * m_optionWords];
+
+        int firstOptionIndex = m_levelOptionIndices[level] + 1;
+        for (int word = firstOptionIndex / 64; word < m_optionWords; ++word)
+        {
+            uint64_t bits = liveOptions[word] & itemOptions[word];
+            if (word == firstOptionIndex / 64)
+                bits &= ~uint64_t(0) << (firstOptionIndex % 64);
+            if (bits)
+                return word * 64 + std::countr_zero(bits);
+        }
+        return -1;
+    }
+
+    int m_itemCount = 0;
+    int m_firstOptionalItem = 0;
+    int m_optionCount = 0;
+    int m_itemWords = 0;
+    int m_optionWords = 0;
+
+    // m_itemOptions has a bitset of options per item, and m_optionItems and m_optionConflicts have a bitset per option
+    std::vector<uint64_t> m_itemOptions;
+    std::vector<uint64_t> m_optionItems;
+    std::vector<uint64_t> m_optionConflicts;
+    std::vector<uint64_t> m_primaryItems;
+
+    // The search stack, with the bitsets for each level
+    int m_level = 0;
+    std::vector<uint64_t> m_levelLiveOptions;
+    std::vector<uint64_t> m_levelUncoveredItems;
+    std::vector<int> m_levelItemIndices;
+    std::vector<int> m_levelOptionIndices;
+    std::vector<int> m_levelOptionNumbers;
+    std::vector<int> m_levelBranchCounts;
+    std::vector<int> m_solutionOptionIndices;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+// Fill a toroidal grid with values, so that every placement of a stencil has each value in it the same number of
+// times. PlusNoise and IGNRelaxed are this with a plus shape and a 3x3 block, and bigger grids and other stencils make
+// tiles like the ones blue noise textures are made from.
+//
+// A stencil is given as a mask of rows of the same length, separated by '/', where 'x' is a cell in the stencil and
+// '.' isn't. Cells are measured from the middle of the mask. For instance ".x./xxx/.x." is the plus shape of
+// PlusNoise, and "xxx/xxx/xxx" is the 3x3 block of IGN.
+struct GridStencil
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::pair<int, int>> offsets;
+
+    // Returns false if the mask isn't valid
+    bool Parse(const char* mask)
+    {
+        width = 0;
+        height = 0;
+        offsets.clear();
+
+        int x = 0;
+        for (const char* c = mask; ; ++c)
+        {
+            if (*c == '/' || *c == 0)
+            {
+                if (height > 0 && x != width)
+                {
+                    printf("Stencil mask \"%s\" has rows of different lengths\n", mask);
+                    return false;
+                }
+                width = x;
+                height++;
+                x = 0;
+                if (*c == 0)
+                    break;
+                continue;
+            }
+
+            if (*c != 'x' && *c != '.')
+            {
+                printf("Stencil mask \"%s\" can only have 'x', '.' and '/' in it\n", mask);
+                return false;
+            }
+
+            if (*c == 'x')
+                offsets.push_back(std::make_pair(x, height));
+            x++;
+        }
+
+        if (offsets.empty())
+        {
+            printf("Stencil mask \"%s\" is empty\n", mask);
+            return false;
+        }
+
+        for (std::pair<int, int>& offset : offsets)
+        {
+            offset.first -= width / 2;
+            offset.second -= height / 2;
+        }
+        return true;
+    }
+
+    // The stencil can't wrap around onto itself, and its cells need to split evenly between the values
+    bool Fits(int gridSize, int valueCount) const
+    {
+        if (gridSize < width || gridSize < height)
+        {
+            printf("A %ix%i stencil doesn't fit in a %ix%i grid\n", width, height, gridSize, gridSize);
+            return false;
+        }
+
+        if (valueCount < 1 || offsets.size() % valueCount != 0)
+        {
+            printf("A stencil with %zu cells can't have each of %i values the same number of times\n", offsets.size(), valueCount);
+            return false;
+        }
+        return true;
+    }
+};
+
+// Make the model for a grid, with a stencil that Fits it.
+// Items:
+//   gridSize^2 cells, which each need a value.
+//   gridSize^2 * valueCount stencil values, one for each value of the placement of the stencil at each cell. These
+//   need to be covered (stencil cells / valueCount) times, which is exactly once when there are as many values as
+//   stencil cells.
+// Options: one for each value of each cell, added in that order, so optionIndex / valueCount is the cell, and
+// optionIndex % valueCount is the value. Each option covers its cell, and its value in every placement that has
+// the cell in it.
+// Item names have to fit in an ItemName, so they are in hex: cells by x and y, and stencil values by the cell index
+// and value. That fits up to a 128x128 grid with 16 values, and bigger models than that are reported as an error.
+template <typename TIndex = int>
+Solver<true, false, TIndex> MakeGridNoiseSolver(int gridSize, int valueCount, const GridStencil& stencil)
+{
+    const int c_numCells = gridSize * gridSize;
+    const int c_stencilSize = (int)stencil.offsets.size();
+    const int c_valueRepeats = c_stencilSize / valueCount;
+
+    const int c_beginCells = 0;
+    const int c_beginStencils = c_beginCells + c_numCells;
+    const int c_numItems = c_beginStencils + c_numCells * valueCount;
+
+    // Set up the items
+    auto solver = Solver<true, false, TIndex>::AddItems(c_numItems);
+    {
+        char name[32];
+        for (int i = 0; i < c_numCells; ++i)
+        {
+            sprintf_s(name, "C%X_%X", i % gridSize, i / gridSize);
+            solver.SetItemName(c_beginCells + i, name);
+        }
+
+        for (int i = 0; i < c_numCells * valueCount; ++i)
+        {
+            sprintf_s(name, "S%X_%X", i / valueCount, i % valueCount);
+            solver.SetItemName(c_beginStencils + i, name);
+            if (c_valueRepeats > 1)
+                solver.SetItemMultiplicity(c_beginStencils + i, c_valueRepeats, c_valueRepeats);
+        }
+    }
+
+    solver.Reserve(c_numCells * valueCount, c_numCells * valueCount * (1 + c_stencilSize));
+
+    // Set up the options, reusing one buffer for all of them
+    std::vector<int> option(1 + c_stencilSize);
+    for (int cell = 0; cell < c_numCells; ++cell)
+    {
+        int cellX = cell % gridSize;
+        int cellY = cell / gridSize;
+        option[0] = c_beginCells + cell;
+
+        for (int value = 0; value < valueCount; ++value)
+        {
+            // The placements that have this cell in them are the ones at the cell minus each stencil offset
+            for (int offsetIndex = 0; offsetIndex < c_stencilSize; ++offsetIndex)
+            {
+                int x = (cellX - stencil.offsets[offsetIndex].first + gridSize) % gridSize;
+                int y = (cellY - stencil.offsets[offsetIndex].second + gridSize) % gridSize;
+                option[1 + offsetIndex] = c_beginStencils + (y * gridSize + x) * valueCount + value;
+            }
+
+            solver.AddOption(option);
+        }
+    }
+
+    return solver;
+}
+
+// Find one grid for a stencil and print it. threadCount is resolved first, with 0 meaning one thread per hardware
+// thread. One thread searches on this thread and stops at the first grid. More use SolveParallel, with the first
+// worker to find a grid stopping the others, which helps with big grids where some of the top branches take much
+// longer than others.
+template <typename TIndex = int>
+void GridNoise(int gridSize, int valueCount, const char* stencilMask, int threadCount)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%ix%i, %i values, \"%s\")\n", gridSize, gridSize, valueCount, stencilMask);
+    printf("===========================================\n");
+
+    GridStencil stencil;
+    if (!stencil.Parse(stencilMask) || !stencil.Fits(gridSize, valueCount))
+    {
+        printf("\n");
+        return;
+    }
+
+    auto solver = MakeGridNoiseSolver<TIndex>(gridSize, valueCount, stencil);
+    if (solver.m_error)
+    {
+        printf("\n");
+        return;
+    }
+
+    // Keep the first grid found
+    std::mutex gridMutex;
+    std::vector<int> grid;
+    auto TakeSolution = [&](const auto& solver)
+    {
+        std::lock_guard<std::mutex> lock(gridMutex);
+        if (!grid.empty())
+            return false;
+
+        grid.resize(gridSize * gridSize);
+        for (int optionIndex : solver.SolutionOptions())
+            grid[optionIndex / valueCount] = optionIndex % valueCount;
+        return true;
+    };
+
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+
+    if (threadCount == 1)
+    {
+        // Leaving the loop stops the search
+        for (const auto& solver : solver.Solutions())
+        {
+            TakeSolution(solver);
+            printf("Found a grid after %zu options tried\n", solver.m_attempts);
+            break;
+        }
+    }
+    else
+    {
+        // Workers notice the stop every so often, so a few more grids can be found before they all stop
+        std::stop_source stopSource;
+        typename decltype(solver)::SearchLimits searchLimits;
+        searchLimits.stopToken = stopSource.get_token();
+        solver.SetSearchLimits(searchLimits);
+        solver.SolveParallel(threadCount,
+            [&](const auto& solver, int)
+            {
+                if (TakeSolution(solver))
+                    stopSource.request_stop();
+            }
+        );
+    }
+
+    if (grid.empty())
+    {
+        printf("No grid found\n\n");
+        return;
+    }
+
+    for (int cell = 0; cell < gridSize * gridSize; ++cell)
+    {
+        if (cell > 0 && cell % gridSize == 0)
+            printf("\n");
+
+        printf(valueCount > 10 ? "%3i" : "%i", grid[cell]);
+    }
+    printf("\n\n");
+}
@@ -29,19 +29,23 @@ inline void IGN()
 
     // Name the items
     {
+        char name[32];
         for (int i = 0; i < 81; ++i)
         {
             int x = i % 9;
             int y = i / 9;
 
             // Cell(x,y) has an item or not
-            sprintf_s(solver.m_items[c_cellsBegin + i].name, "Cel%i_%i", x, y);
+            sprintf_s(name, "Cel%i_%i", x, y);
+            solver.SetItemName(c_cellsBegin + i, name);
 
             // Row(x) has item y or not
-            sprintf_s(solver.m_items[c_rowsBegin + i].name, "Row%i_%i", x, y);
+            sprintf_s(name, "Row%i_%i", x, y);
+            solver.SetItemName(c_rowsBegin + i, name);
 
             // Col(x) has item y or not
-            sprintf_s(solver.m_items[c_colsBegin + i].name, "Col%i_%i", x, y);
+            sprintf_s(name, "Col%i_%i", x, y);
+            solver.SetItemName(c_colsBegin + i, name);
         }
 
         for (int i = 0; i < 729; ++i)
@@ -50,10 +54,14 @@ inline void IGN()
             int value = i % 9;
 
             // Block(block) has item 'value' or not
-            sprintf_s(solver.m_items[c_blocksBegin + i].name, "Blk%i_%i", block, value);
+            sprintf_s(name, "Blk%i_%i", block, value);
+            solver.SetItemName(c_blocksBegin + i, name);
         }
     }
 
+    // 9 options for each of the 81 cells, with 12 items each
+    solver.Reserve(81 * 9, 81 * 9 * 12);
+
     // Make the 9 options for each spot on the board
     {
         // A lambda to calculate the item index for adding a value to plus shape
@@ -94,9 +102,9 @@ inline void IGN()
                 }
 
                 // For debugging
-                //char* optionNames[12];
+                //const char* optionNames[12];
                 //for (int i = 0; i < 12; ++i)
-                    //optionNames[i] = solver.m_items[option[i]].name;
+                    //optionNames[i] = solver.ItemNames()[option[i]].name;
 
                 solver.AddOption(option);
             }
@@ -112,21 +120,12 @@ inline void IGN()
             solutionCount++;
             printf("Solution #%i...", solutionCount);
 
-            for (int optionIndex : solver.m_solutionOptionNodeIndices)
+            // There are 9 options per cell, one for each value, added in order
+            for (int optionIndex : solver.SolutionOptions())
             {
-                // Find the spacer node for this option
-                int spacerNode = optionIndex;
-                while (solver.m_nodes[spacerNode].itemIndex != -1)
-                    spacerNode--;
-
-                // get the cell and value
-                int cell = solver.m_nodes[spacerNode + 1].itemIndex - c_cellsBegin;
-                int cellY = cell / 9;
-                int itemIndex = solver.m_nodes[spacerNode + 2].itemIndex;
-                int value = 1 + itemIndex - (c_rowsBegin + (cellY) * 9);
-
-                // set it
-                solvedBoard[cell] = value;
+                int cell = optionIndex / 9;
+                int value = optionIndex % 9;
+                solvedBoard[cell] = value + 1;
             }
 
             for (int cell = 0; cell < 81; ++cell)
@@ -146,7 +145,7 @@ inline void IGN()
     );
 }
 
-inline void IGNRelaxed()
+inline void IGNRelaxed(const char* solutionFileName = nullptr)
 {
     printf("===========================================\n");
     printf(__FUNCTION__ "\n");
@@ -158,119 +157,61 @@ inline void IGNRelaxed()
     // The number of constraints are...
     // A)  81 for cells   : The 9x9 grid must have a value in each location
     // B) 729 for blocks  : Every cell has a 3x3 block surrounding it, so 81 blocks, that must each have of the 9 values in them.
-    // A + B + C + D = 810
-    const int c_cellsBegin = 0;
-    const int c_blocksBegin = c_cellsBegin + 81;
-    const int c_numItems = c_blocksBegin + 729;
-
-    // Create the solver
-    auto solver = Solver<true>::AddItems(c_numItems);
-
-    // Name the items
+    // A + B = 810
+    // 9 options for each of the 81 cells, with 10 items each.
+    GridStencil stencil;
+    stencil.Parse("xxx/xxx/xxx");
+    auto solver = MakeGridNoiseSolver(9, 9, stencil);
+
+    // With a file name, write every solution to it instead of printing some of them.
+    // Each solution has an option for each of the 81 cells.
+    if (solutionFileName)
     {
-        for (int i = 0; i < 81; ++i)
+        SolutionWriter writer;
+        if (writer.Open(solutionFileName, 81 * 9, 81))
         {
-            int x = i % 9;
-            int y = i / 9;
-
-            // Cell(x,y) has an item or not
-            sprintf_s(solver.m_items[c_cellsBegin + i].name, "Cel%i_%i", x, y);
-        }
-
-        for (int i = 0; i < 729; ++i)
-        {
-            int block = i / 9;
-            int value = i % 9;
-
-            // Block(block) has item 'value' or not
-            sprintf_s(solver.m_items[c_blocksBegin + i].name, "Blk%i_%i", block, value);
+            solver.SolveParallel(0, writer.Sink());
+            writer.Close();
         }
+        return;
     }
 
-    // Make the 9 options for each spot on the board
-    {
-        // A lambda to calculate the item index for adding a value to plus shape
-        auto BlockItemIndex = [=](int cell, int offsetX, int offsetY, int value)
+    // Solve on all cores and print out some of the solutions.
+    // Each worker gets its own matrix, and prints a whole solution at once, so the workers don't need to lock.
+    // The solutions are counted across all of the workers, so every 543rd solution of the whole search is printed.
+    std::atomic<size_t> solutionsFound = 0;
+    std::vector<std::vector<int>> workerMatrices(std::max(1u, std::thread::hardware_concurrency()), std::vector<int>(81));
+    solver.SolveParallel((int)workerMatrices.size(),
+        [&](const auto& solver, int workerId)
         {
-            const int c_gridSize = 9;
-            const int c_numValues = 9;
-
-            int x = cell % c_gridSize;
-            int y = cell / c_gridSize;
-            x = (x + offsetX + c_gridSize) % c_gridSize;
-            y = (y + offsetY + c_gridSize) % c_gridSize;
-            int plusIndex = y * c_gridSize + x;
-            return c_blocksBegin + plusIndex * c_numValues + value;
-        };
-
-        int option[10];
-        for (int cell = 0; cell < 9 * 9; ++cell)
-        {
-            option[0] = c_cellsBegin + cell;
-
-            int cellX = cell % 9;
-            int cellY = cell / 9;
-            int blockX = cellX / 3;
-            int blockY = cellY / 3;
-            int block = blockY * 3 + blockX;
-
-            for (int value = 0; value < 9; ++value)
-            {
-                for (int offset = 0; offset < 9; ++offset)
-                {
-                    int offsetX = (offset % 3) - 1;
-                    int offsetY = (offset / 3) - 1;
-                    option[1 + offset] = BlockItemIndex(cell, offsetX, offsetY, value);
-                }
-
-                // For debugging
-                //char* optionNames[12];
-                //for (int i = 0; i < 12; ++i)
-                    //optionNames[i] = solver.m_items[option[i]].name;
-
-                solver.AddOption(option);
-            }
-        }
-    }
-
-    // Solve and print out the solution
-    std::vector<int> matrix(81);
-    solver.Solve(
-        [&](const auto& solver)
-        {
-            if ((solver.m_solutionsFound % 543) != 0)
+            size_t solutionNumber = ++solutionsFound;
+            if ((solutionNumber % 543) != 0)
                 return;
 
-            printf("Solution #%i...", (int)solver.m_solutionsFound);
+            std::vector<int>& matrix = workerMatrices[workerId];
 
             // Make the solution
-            for (int optionIndex : solver.m_solutionOptionNodeIndices)
+            for (int optionIndex : solver.SolutionOptions())
             {
-                // Find the spacer node for this option
-                int spacerNode = optionIndex;
-                while (solver.m_nodes[spacerNode].itemIndex != -1)
-                    spacerNode--;
-
-                // get the cell and value
-                int cell = solver.m_nodes[spacerNode + 1].itemIndex - c_cellsBegin;
-                int cellY = cell / 9;
-                int value = (solver.m_nodes[spacerNode + 2].itemIndex - c_blocksBegin) % 9;
+                int cell = optionIndex / 9;
+                int value = optionIndex % 9;
                 matrix[cell] = value;
             }
 
+            std::string text = "Solution #" + std::to_string(solutionNumber) + " (worker " + std::to_string(workerId) + ")...";
             for (int cell = 0; cell < 81; ++cell)
             {
                 if (cell > 0 && cell % 27 == 0)
-                    printf("\n\n");
+                    text += "\n\n";
                 else if (cell % 9 == 0)
-                    printf("\n");
+                    text += "\n";
                 else if (cell % 3 == 0)
-                    printf(" ");
+                    text += " ";
 
-                printf("%i ", matrix[cell] + 1);
+                text += std::to_string(matrix[cell] + 1) + " ";
             }
 
-            printf("\n\n");
+            printf("%s\n\n", text.c_str());
         }
     );
 }
\ No newline at end of file
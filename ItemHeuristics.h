@@ -0,0 +1,130 @@
+#pragma once
+
+// Policies for choosing which item to branch on, given as Solver's TItemHeuristic template parameter.
+// Solver::ChooseItem goes through the active primary items in order, starting with the first one as the choice,
+// and asks Prefer whether each later item should be chosen instead. The score is how many ways there are to branch
+// on the item, which is its option count for plain exact cover. Items with a score of 0 mean the search has to
+// backtrack, which Solver handles itself, and tells the heuristic about with Conflict.
+//
+// c_stateless says the choice only depends on the items, so that a path of option numbers goes to the same place
+// every time. Parallel solves, shards and checkpoints rely on that, so they need a stateless heuristic.
+
+// Minimum remaining values: the first item with the fewest options. This is the default, and Knuth's choice.
+struct MrvHeuristic
+{
+    static const bool c_stateless = true;
+
+    void Init(std::span<const ItemName>) {}
+    void StartChoosing() {}
+
+    bool Prefer(int, int score, int, int chosenScore)
+    {
+        return score < chosenScore;
+    }
+
+    void Conflict(int) {}
+};
+
+// Minimum remaining values, with a random choice among the items that tie for the fewest options
+struct MrvRandomTiesHeuristic
+{
+    static const bool c_stateless = false;
+
+    void Init(std::span<const ItemName>)
+    {
+        m_rng = GetRNG();
+    }
+
+    void StartChoosing()
+    {
+        m_tieCount = 1;
+    }
+
+    // Each of the tied items ends up chosen with the same chance, without having to remember them
+    bool Prefer(int, int score, int, int chosenScore)
+    {
+        if (score < chosenScore)
+        {
+            m_tieCount = 1;
+            return true;
+        }
+
+        if (score > chosenScore)
+            return false;
+
+        m_tieCount++;
+        return std::uniform_int_distribution<int>(0, m_tieCount - 1)(m_rng) == 0;
+    }
+
+    void Conflict(int) {}
+
+private:
+    std::mt19937 m_rng;
+    int m_tieCount = 1;
+};
+
+// Knuth's sharp preference: items with names that start with '#' are chosen before the others, by fewest options.
+// Other items are only chosen ahead of them when they are forced, with one option left, or when no sharp items are left.
+struct SharpHeuristic
+{
+    static const bool c_stateless = true;
+
+    void Init(std::span<const ItemName> itemNames)
+    {
+        m_sharp.resize(itemNames.size());
+        for (size_t itemIndex = 0; itemIndex < itemNames.size(); ++itemIndex)
+            m_sharp[itemIndex] = itemNames[itemIndex].name[0] == '#';
+    }
+
+    void StartChoosing() {}
+
+    bool Prefer(int itemIndex, int score, int chosenItemIndex, int chosenScore)
+    {
+        int rank = Rank(itemIndex, score);
+        int chosenRank = Rank(chosenItemIndex, chosenScore);
+        return rank < chosenRank || (rank == chosenRank && score < chosenScore);
+    }
+
+    void Conflict(int) {}
+
+private:
+    int Rank(int itemIndex, int score) const
+    {
+        return (m_sharp[itemIndex] || score <= 1) ? 0 : 1;
+    }
+
+    std::vector<bool> m_sharp;
+};
+
+// Weighted by conflicts: each time an item runs out of options, its weight goes up, and items are chosen by the
+// fewest options per weight. Items that keep causing dead ends get branched on earlier, so the search finds those
+// dead ends higher up in the tree. This is like the dom/wdeg heuristic of constraint solvers.
+struct ConflictWeightedHeuristic
+{
+    static const bool c_stateless = false;
+
+    void Init(std::span<const ItemName> itemNames)
+    {
+        m_weights.assign(itemNames.size(), 1.0);
+    }
+
+    void StartChoosing() {}
+
+    bool Prefer(int itemIndex, int score, int chosenItemIndex, int chosenScore)
+    {
+        return double(score) * m_weights[chosenItemIndex] < double(chosenScore) * m_weights[itemIndex];
+    }
+
+    void Conflict(int itemIndex)
+    {
+        m_weights[itemIndex] += 1.0;
+    }
+
+    const std::vector<double>& Weights() const
+    {
+        return m_weights;
+    }
+
+private:
+    std::vector<double> m_weights;
+};
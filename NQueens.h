@@ -1,25 +1,30 @@
 #pragma once
 
-template <bool EXHAUSTIVE>
-void NQueens(int boardSize)
+// Make the model for a board.
+// Items: a primary item for each column (X) and row (Y), and a secondary item for each diagonal going down to the
+// right (DR) and to the left (DL), since not every diagonal has a queen on it.
+// Options: one for each cell, added in order, so the option index is the cell.
+template <bool EXHAUSTIVE, typename TIndex = int, typename TSearchStats = NoSearchStats, typename TItemHeuristic = MrvHeuristic>
+Solver<EXHAUSTIVE, false, TIndex, TSearchStats, TItemHeuristic> MakeNQueensSolver(int boardSize)
 {
-    printf("===========================================\n");
-    printf(__FUNCTION__ "(%i)\n", boardSize);
-    printf("===========================================\n");
-
     // Set up the items
-    auto solver = Solver<EXHAUSTIVE>::AddItems(boardSize + boardSize + (2 * boardSize - 1) + (2 * boardSize - 1), 2 * boardSize);
+    auto solver = Solver<EXHAUSTIVE, false, TIndex, TSearchStats, TItemHeuristic>::AddItems(boardSize + boardSize + (2 * boardSize - 1) + (2 * boardSize - 1), 2 * boardSize);
     {
+        char name[32];
         for (int i = 0; i < boardSize; ++i)
         {
-            sprintf_s(solver.m_items[i].name, "X%i", i);
-            sprintf_s(solver.m_items[boardSize + i].name, "Y%i", i);
+            sprintf_s(name, "X%i", i);
+            solver.SetItemName(i, name);
+            sprintf_s(name, "Y%i", i);
+            solver.SetItemName(boardSize + i, name);
         }
 
         for (int i = 0; i < 2 * boardSize - 1; ++i)
         {
-            sprintf_s(solver.m_items[2 * boardSize + i].name, "DR%i", i);
-            sprintf_s(solver.m_items[2 * boardSize + (2 * boardSize - 1) + i].name, "DL%i", i);
+            sprintf_s(name, "DR%i", i);
+            solver.SetItemName(2 * boardSize + i, name);
+            sprintf_s(name, "DL%i", i);
+            solver.SetItemName(2 * boardSize + (2 * boardSize - 1) + i, name);
         }
     }
 
@@ -38,6 +43,23 @@ void NQueens(int boardSize)
         solver.AddOption({ c_beginX + x, c_beginY + y, c_beginDR + dr, c_beginDL + dl });
     }
 
+    return solver;
+}
+
+// With breakSymmetries, only one solution is found for each set of solutions that are rotations or reflections of
+// each other. There are 12 of those for 8 queens, out of 92 solutions.
+template <bool EXHAUSTIVE, typename TIndex = int, typename TSearchStats = NoSearchStats, typename TItemHeuristic = MrvHeuristic>
+void NQueens(int boardSize, bool breakSymmetries = false)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i%s)\n", boardSize, breakSymmetries ? ", breaking symmetries" : "");
+    printf("===========================================\n");
+
+    auto solver = MakeNQueensSolver<EXHAUSTIVE, TIndex, TSearchStats, TItemHeuristic>(boardSize);
+
+    if (breakSymmetries)
+        AddSquareBoardSymmetries(solver, boardSize);
+
     // Solve
     int solutionCount = 0;
     solver.Solve([&] (const auto& solver)
@@ -48,29 +70,219 @@ void NQueens(int boardSize)
             solutionCount++;
             printf("Solution #%i...", solutionCount);
 
-            // Fill out the board
-            std::vector<char> solution(boardSize * boardSize, '.');
-            for (int optionIndex : solver.m_solutionOptionNodeIndices)
-            {
-                int spacerIndex = optionIndex;
-                while (solver.m_nodes[spacerIndex].itemIndex != -1)
-                    spacerIndex--;
+            PrintBoard(boardSize, solver.SolutionOptions(), 'Q');
+        }
+    );
+}
+
+// Make a ZDD of all of the solutions, write it to a file, and read it back to count and show them
+template <typename TIndex = int>
+void NQueensZdd(int boardSize)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i)\n", boardSize);
+    printf("===========================================\n");
+
+    auto solver = MakeNQueensSolver<true, TIndex>(boardSize);
 
-                int optionIndex = (spacerIndex - solver.m_rootItemIndex) / 5;
+    // Make the ZDD and write it out
+    char fileName[64];
+    sprintf_s(fileName, "NQueens%i.zdd", boardSize);
+    if (!solver.MakeSolutionZdd().WriteToFile(fileName))
+        return;
 
-                solution[optionIndex] = 'Q';
-            }
+    // Read it back in and use it without the solver
+    SolutionZdd zdd;
+    if (!zdd.ReadFromFile(fileName))
+        return;
 
-            // print the board
-            for (int cell = 0; cell < boardSize * boardSize; ++cell)
-            {
-                if (cell % boardSize == 0)
-                    printf("\n");
+    printf("%s has %zu nodes and %s solutions\n", fileName, zdd.nodes.size(), zdd.Count().ToString().c_str());
 
-                printf("%c", solution[cell]);
-            }
+    bool shown = false;
+    zdd.ForEachSolution([&](std::span<const int> options)
+        {
+            if (shown)
+                return;
+            shown = true;
 
-            printf("\n\n");
+            PrintBoard(boardSize, options, 'Q');
         }
     );
-}
\ No newline at end of file
+}
+
+// Pull the first few solutions of a board that is too big to find all of the solutions for
+template <typename TIndex = int>
+void NQueensFirstSolutions(int boardSize, int solutionCount)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i, %i)\n", boardSize, solutionCount);
+    printf("===========================================\n");
+
+    auto solver = MakeNQueensSolver<true, TIndex>(boardSize);
+
+    // Take solutions until we have enough. Leaving the loop stops the search.
+    int solutionsShown = 0;
+    for (const auto& solver : solver.Solutions())
+    {
+        solutionsShown++;
+        printf("Solution #%i (%zu options tried)...", solutionsShown, solver.m_attempts);
+
+        PrintBoard(boardSize, solver.SolutionOptions(), 'Q');
+
+        if (solutionsShown >= solutionCount)
+            break;
+    }
+}
+
+// Estimate how big the search is from random probes, and then do the search to compare
+template <typename TIndex = int>
+void NQueensEstimate(int boardSize, int probeCount)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i, %i)\n", boardSize, probeCount);
+    printf("===========================================\n");
+
+    auto solver = MakeNQueensSolver<true, TIndex>(boardSize);
+
+    solver.EstimateTreeSize(probeCount);
+    solver.Solve();
+}
+
+// Stop a search every so often, like a job on a cluster being preempted, and carry on from a checkpoint with a
+// new solver each time
+template <typename TIndex = int>
+void NQueensCheckpoint(int boardSize, size_t attemptsPerRun)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i, %zu)\n", boardSize, attemptsPerRun);
+    printf("===========================================\n");
+
+    char fileName[64];
+    sprintf_s(fileName, "NQueens%i.checkpoint", boardSize);
+
+    for (int run = 0; ; ++run)
+    {
+        auto solver = MakeNQueensSolver<true, TIndex>(boardSize);
+
+        // The first run starts the search, and the others carry on from the checkpoint the run before left
+        solver.SetSearchLimits({ {}, attemptsPerRun, 0.0 });
+        solver.SetCheckpointFile(fileName, 60.0);
+        auto dummy = [](const auto&) {};
+        if (run == 0)
+            solver.Solve(dummy);
+        else if (!solver.SolveFromCheckpoint(fileName, dummy))
+            return;
+
+        if (solver.m_stopReason == decltype(solver)::StopReason::None)
+            break;
+    }
+}
+
+// Split a search into shards, like separate processes would, and merge their count files
+template <typename TIndex = int>
+void NQueensShards(int boardSize, int shardCount, int splitLevel)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i, %i, %i)\n", boardSize, shardCount, splitLevel);
+    printf("===========================================\n");
+
+    for (int shardIndex = 0; shardIndex < shardCount; ++shardIndex)
+    {
+        auto solver = MakeNQueensSolver<true, TIndex>(boardSize);
+
+        // Each shard writes its own counts file
+        char fileName[64];
+        sprintf_s(fileName, "NQueens%i.shard%i", boardSize, shardIndex);
+        auto dummy = [](const auto&) {};
+        if (!solver.SolveShard(shardIndex, shardCount, splitLevel, dummy).WriteToFile(fileName))
+            return;
+    }
+
+    // Merge the counts files
+    ShardCounts total;
+    for (int shardIndex = 0; shardIndex < shardCount; ++shardIndex)
+    {
+        char fileName[64];
+        sprintf_s(fileName, "NQueens%i.shard%i", boardSize, shardIndex);
+        ShardCounts shardCounts;
+        if (!shardCounts.ReadFromFile(fileName) || !total.Merge(shardCounts))
+            return;
+    }
+
+    printf("Merged %zu of %u shards: %llu solutions found (%llu options tried, max recursion depth %i)%s\n\n", total.shardIndices.size(), total.shardCount,
+        (unsigned long long)total.solutionsFound, (unsigned long long)total.attempts, total.maxRecursionDepth, total.IsComplete() ? "" : ", not complete");
+}
+
+// Find all solutions with the given item heuristic, to compare how many options each one tries.
+// The rows are named with a '#' so that SharpHeuristic branches on rows first, like placing a queen per row.
+template <typename TItemHeuristic, typename TIndex = int>
+void NQueensHeuristic(int boardSize, const char* heuristicName)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i, %s)\n", boardSize, heuristicName);
+    printf("===========================================\n");
+
+    auto solver = MakeNQueensSolver<true, TIndex, NoSearchStats, TItemHeuristic>(boardSize);
+    char name[32];
+    for (int i = 0; i < boardSize; ++i)
+    {
+        sprintf_s(name, "#Y%i", i);
+        solver.SetItemName(boardSize + i, name);
+    }
+
+    solver.Solve();
+}
+
+// Write every solution to a file as they are found, instead of printing them, then read them back.
+// The file is written from a background thread while the search runs on all cores.
+template <typename TIndex = int>
+void NQueensSolutionFile(int boardSize, SolutionWriter::Format format)
+{
+    const char* formatName = (format == SolutionWriter::Format::OptionIndices) ? "option indices" : "bitset deltas";
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i, %s)\n", boardSize, formatName);
+    printf("===========================================\n");
+
+    auto solver = MakeNQueensSolver<true, TIndex>(boardSize);
+
+    // Every solution has a queen in each row
+    char fileName[256];
+    sprintf_s(fileName, "NQueens%i.solutions", boardSize);
+    SolutionWriter writer;
+    if (!writer.Open(fileName, boardSize * boardSize, boardSize, format))
+        return;
+
+    solver.SolveParallel(0, writer.Sink());
+    if (!writer.Close())
+        return;
+
+    // Read them back, and make sure each one has a queen in every row and column
+    SolutionReader reader;
+    if (!reader.Open(fileName))
+        return;
+
+    size_t solutionsRead = 0;
+    size_t badSolutions = 0;
+    std::vector<int> optionIndices;
+    std::vector<int> rowCounts(boardSize);
+    std::vector<int> columnCounts(boardSize);
+    while (reader.Next(optionIndices))
+    {
+        std::fill(rowCounts.begin(), rowCounts.end(), 0);
+        std::fill(columnCounts.begin(), columnCounts.end(), 0);
+        for (int optionIndex : optionIndices)
+        {
+            rowCounts[optionIndex / boardSize]++;
+            columnCounts[optionIndex % boardSize]++;
+        }
+
+        bool valid = optionIndices.size() == size_t(boardSize);
+        for (int i = 0; i < boardSize; ++i)
+            valid = valid && rowCounts[i] == 1 && columnCounts[i] == 1;
+        if (!valid)
+            badSolutions++;
+        solutionsRead++;
+    }
+
+    printf("Read %zu of %llu solutions from %s, %zu of them not valid\n\n", solutionsRead, (unsigned long long)reader.SolutionCount(), fileName, badSolutions);
+}
@@ -1,19 +1,68 @@
 #pragma once
 
-template <bool EXHAUSTIVE>
-void NRooks(int boardSize)
+// Add the 7 symmetries of a square board other than the identity, as rotations and reflections of the cells.
+// This is for models with one option per cell, added in order, so that the option index is the cell.
+template <typename TSolver>
+void AddSquareBoardSymmetries(TSolver& solver, int boardSize)
 {
-    printf("===========================================\n");
-    printf(__FUNCTION__ "(%i)\n", boardSize);
-    printf("===========================================\n");
+    std::vector<int> permutation(boardSize * boardSize);
+    for (int symmetry = 1; symmetry < 8; ++symmetry)
+    {
+        for (int cell = 0; cell < boardSize * boardSize; ++cell)
+        {
+            int x = cell % boardSize;
+            int y = cell / boardSize;
+
+            // Reflect across the diagonal, then rotate by a quarter turn as many times as needed
+            if (symmetry & 4)
+                std::swap(x, y);
+            for (int turn = 0; turn < (symmetry & 3); ++turn)
+            {
+                int oldX = x;
+                x = boardSize - 1 - y;
+                y = oldX;
+            }
+
+            permutation[cell] = y * boardSize + x;
+        }
+        solver.AddSymmetry(permutation);
+    }
+}
+
+// Print a board with the piece on the cells of a solution's options, for models with one option per cell, added in
+// order, so that the option index is the cell.
+inline void PrintBoard(int boardSize, std::span<const int> options, char piece)
+{
+    std::vector<char> solution(boardSize * boardSize, '.');
+    for (int optionIndex : options)
+        solution[optionIndex] = piece;
+
+    for (int cell = 0; cell < boardSize * boardSize; ++cell)
+    {
+        if (cell % boardSize == 0)
+            printf("\n");
 
+        printf("%c", solution[cell]);
+    }
+
+    printf("\n\n");
+}
+
+// Make the model for a board, with a primary item for each column (X) and row (Y), and an option for each cell,
+// added in order, so the option index is the cell.
+template <bool EXHAUSTIVE, typename TIndex = int>
+Solver<EXHAUSTIVE, false, TIndex> MakeNRooksSolver(int boardSize)
+{
     // Set up the items
-    auto solver = Solver<EXHAUSTIVE>::AddItems(boardSize + boardSize);
+    auto solver = Solver<EXHAUSTIVE, false, TIndex>::AddItems(boardSize + boardSize);
     {
+        char name[32];
         for (int i = 0; i < boardSize; ++i)
         {
-            sprintf_s(solver.m_items[i].name, "X%i", i);
-            sprintf_s(solver.m_items[boardSize + i].name, "Y%i", i);
+            sprintf_s(name, "X%i", i);
+            solver.SetItemName(i, name);
+            sprintf_s(name, "Y%i", i);
+            solver.SetItemName(boardSize + i, name);
         }
     }
 
@@ -25,9 +74,26 @@ void NRooks(int boardSize)
     {
         int x = i % boardSize;
         int y = i / boardSize;
-        solver.AddOption({ c_beginX + x, c_beginY + y});
+        solver.AddOption({ c_beginX + x, c_beginY + y });
     }
 
+    return solver;
+}
+
+// With breakSymmetries, only one solution is found for each set of solutions that are rotations or reflections of
+// each other.
+template <bool EXHAUSTIVE, typename TIndex = int>
+void NRooks(int boardSize, bool breakSymmetries = false)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i%s)\n", boardSize, breakSymmetries ? ", breaking symmetries" : "");
+    printf("===========================================\n");
+
+    auto solver = MakeNRooksSolver<EXHAUSTIVE, TIndex>(boardSize);
+
+    if (breakSymmetries)
+        AddSquareBoardSymmetries(solver, boardSize);
+
     // Solve
     int solutionCount = 0;
     solver.Solve([&] (const auto& solver)
@@ -38,29 +104,23 @@ void NRooks(int boardSize)
             solutionCount++;
             printf("Solution #%i...", solutionCount);
 
-            // Fill out the board
-            std::vector<char> solution(boardSize * boardSize, '.');
-            for (int optionIndex : solver.m_solutionOptionNodeIndices)
-            {
-                int spacerIndex = optionIndex;
-                while (solver.m_nodes[spacerIndex].itemIndex != -1)
-                    spacerIndex--;
-
-                int optionIndex = (spacerIndex - solver.m_rootItemIndex) / 3;
-
-                solution[optionIndex] = 'R';
-            }
+            PrintBoard(boardSize, solver.SolutionOptions(), 'R');
+        }
+    );
+}
 
-            // print the board
-            for (int cell = 0; cell < boardSize * boardSize; ++cell)
-            {
-                if (cell % boardSize == 0)
-                    printf("\n");
+// Count the solutions without visiting each one, which is n! for n rooks.
+// After placing rooks in the first rows, the rest of the search only depends on which columns are left, so the
+// memoized count only has to search 2^n states instead of n! solutions.
+template <typename TIndex = int>
+void NRooksCount(int boardSize)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i)\n", boardSize);
+    printf("===========================================\n");
 
-                printf("%c", solution[cell]);
-            }
+    auto solver = MakeNRooksSolver<true, TIndex>(boardSize);
 
-            printf("\n\n");
-        }
-    );
-}
\ No newline at end of file
+    // Count
+    solver.CountSolutions();
+}
@@ -20,61 +20,12 @@ inline void PlusNoise()
 
     const int c_numCells = c_gridSize * c_gridSize;
 
-    const int c_beginCells = 0;
-    const int c_beginPluses = c_beginCells + c_numCells;
-    const int c_numItems = c_beginPluses + c_numCells * c_numValues;
-
-    // Set up the items
-    auto solver = Solver<true>::AddItems(c_numItems);
-    {
-        for (int i = 0; i < c_numCells; ++i)
-            sprintf_s(solver.m_items[c_beginCells + i].name, "C%i_%i", i % c_gridSize, i / c_gridSize);
-
-        for (int i = 0; i < c_numCells * c_numValues; ++i)
-        {
-            int plusIndex = i / c_numValues;
-            int value = i % c_numValues;
-
-            sprintf_s(solver.m_items[c_beginPluses + i].name, "P%i_%i", plusIndex, value);
-        }
-    }
-
-    // Set up the options. There is one option per value per cell, so 45 options total.
+    // Set up the items and options. There is one option per value per cell, so 125 options total.
     // Each option specifies what cell it is in, and also, what value it is putting into each
-    // of the 5 Plus shapes it occupies.
-    {
-        // A lambda to calculate the item index for adding a value to plus shape
-        auto PlusValueItemIndex = [=](int cell, int offsetX, int offsetY, int value)
-        {
-            int x = cell % c_gridSize;
-            int y = cell / c_gridSize;
-            x = (x + offsetX + c_gridSize) % c_gridSize;
-            y = (y + offsetY + c_gridSize) % c_gridSize;
-            int plusIndex = y * c_gridSize + x;
-            return c_beginPluses + plusIndex * c_numValues + value;
-        };
-
-        int option[6];
-        for (int i = 0; i < c_numCells * c_numValues; ++i)
-        {
-            // Calculate cell and value
-            int cell = i / c_numValues;
-            int value = i % c_numValues;
-
-            // What cell is covered
-            option[0] = c_beginCells + cell;
-
-            // Put this value into each of the plus shapes
-            option[1] = PlusValueItemIndex(cell,  0,  0, value);
-            option[2] = PlusValueItemIndex(cell, -1,  0, value);
-            option[3] = PlusValueItemIndex(cell,  1,  0, value);
-            option[4] = PlusValueItemIndex(cell,  0, -1, value);
-            option[5] = PlusValueItemIndex(cell,  0,  1, value);
-
-            // Add the option
-            solver.AddOption(option);
-        }
-    }
+    // of the 5 plus shapes it occupies.
+    GridStencil stencil;
+    stencil.Parse(".x./xxx/.x.");
+    auto solver = MakeGridNoiseSolver(c_gridSize, c_numValues, stencil);
 
     // Solve and show solutions
     int solutionCount = 0;
@@ -88,13 +39,8 @@ inline void PlusNoise()
 
             // Fill out the result
             std::vector<int> solution(c_numCells);
-            for (int optionNodeIndex : solver.m_solutionOptionNodeIndices)
+            for (int optionIndex : solver.SolutionOptions())
             {
-                int spacerIndex = optionNodeIndex;
-                while (solver.m_nodes[spacerIndex].itemIndex != -1)
-                    spacerIndex--;
-
-                int optionIndex = (spacerIndex - solver.m_rootItemIndex) / 7;
                 int cell = optionIndex / c_numValues;
                 int value = optionIndex % c_numValues;
 
@@ -0,0 +1,101 @@
+#pragma once
+
+// Instrumentation policies for Solver, given as its TSearchStats template parameter.
+// NoSearchStats does nothing, so the calls to it compile away. SearchStats counts link updates, which are like
+// Knuth's mems in that they measure the work of a search in a way that doesn't depend on the machine, and keeps
+// per depth counts of the nodes of the search tree, how many ways they branched, and how many were dead ends.
+// Dead ends are nodes where some item had no options left.
+struct NoSearchStats
+{
+    static const bool c_enabled = false;
+
+    void Reset() {}
+    void LinkUpdates(int) {}
+    void VisitNode(int) {}
+    void Branch(int, int) {}
+    void DeadEnd(int) {}
+    void Merge(const NoSearchStats&) {}
+    void Print() const {}
+};
+
+struct SearchStats
+{
+    static const bool c_enabled = true;
+
+    void Reset()
+    {
+        linkUpdates = 0;
+        levelNodes.clear();
+        levelBranchingNodes.clear();
+        levelBranches.clear();
+        levelDeadEnds.clear();
+    }
+
+    void LinkUpdates(int count)
+    {
+        linkUpdates += count;
+    }
+
+    void VisitNode(int level)
+    {
+        Grow(level);
+        levelNodes[level]++;
+    }
+
+    void Branch(int level, int branchCount)
+    {
+        Grow(level);
+        levelBranchingNodes[level]++;
+        levelBranches[level] += branchCount;
+    }
+
+    void DeadEnd(int level)
+    {
+        Grow(level);
+        levelDeadEnds[level]++;
+    }
+
+    // Add the counts of another search, like one of the workers of a parallel search
+    void Merge(const SearchStats& other)
+    {
+        linkUpdates += other.linkUpdates;
+        if (!other.levelNodes.empty())
+            Grow(int(other.levelNodes.size()) - 1);
+        for (size_t level = 0; level < other.levelNodes.size(); ++level)
+        {
+            levelNodes[level] += other.levelNodes[level];
+            levelBranchingNodes[level] += other.levelBranchingNodes[level];
+            levelBranches[level] += other.levelBranches[level];
+            levelDeadEnds[level] += other.levelDeadEnds[level];
+        }
+    }
+
+    void Print() const
+    {
+        printf("%llu link updates\n", (unsigned long long)linkUpdates);
+        printf("Depth      Nodes  Branching  Dead ends\n");
+        for (size_t level = 0; level < levelNodes.size(); ++level)
+        {
+            double branching = levelBranchingNodes[level] > 0 ? double(levelBranches[level]) / double(levelBranchingNodes[level]) : 0.0;
+            printf("%5zu %10llu %10.2f %10llu\n", level, (unsigned long long)levelNodes[level], branching, (unsigned long long)levelDeadEnds[level]);
+        }
+    }
+
+    uint64_t linkUpdates = 0;
+    std::vector<uint64_t> levelNodes;
+    std::vector<uint64_t> levelBranchingNodes;
+    std::vector<uint64_t> levelBranches;
+    std::vector<uint64_t> levelDeadEnds;
+
+private:
+    void Grow(int level)
+    {
+        if (level < (int)levelNodes.size())
+            return;
+
+        levelNodes.resize(level + 1, 0);
+        levelBranchingNodes.resize(level + 1, 0);
+        levelBranches.resize(level + 1, 0);
+        levelDeadEnds.resize(level + 1, 0);
+    }
+};
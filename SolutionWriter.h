@@ -0,0 +1,402 @@
+#pragma once
+
+// Writing solutions to a binary file, for enumerating far more solutions than are worth printing.
+// Each solution is a fixed size record, copied into a big buffer without any formatting, and a background thread
+// writes the full buffers to the file while the search carries on. There are a few buffers that go back and forth
+// between the search and the writer thread, so nothing is allocated per solution, and if the disk can't keep up,
+// the search waits for a buffer instead of using more memory.
+//
+// The records are one of:
+//  OptionIndices: the option indices of the solution in the order the search took them, as uint16s if every option
+//                 index fits and uint32s if not, padded with all bits set up to recordOptions.
+//  BitsetDeltas:  a bit per option of which options are in the solution, xored with the bits of the solution before
+//                 it. The search finds solutions next to each other in the tree one after the other, so most of the
+//                 bits are 0, which a general purpose compressor does well with.
+//
+// The file is a header of 6 uint32s (magic, version, format, option count, record options, record bytes) and a
+// uint64 solution count, then the records. Write can be called from several threads at once, like the workers of
+// SolveParallel, in which case the solutions are in the order the workers found them.
+class SolutionWriter
+{
+public:
+    static const uint32_t c_fileMagic = 0x4F584C44; // "DLXO"
+    static const uint32_t c_fileVersion = 1;
+    static constexpr size_t c_bufferSize = 4 * 1024 * 1024;
+    static const int c_bufferCount = 4;
+
+    enum class Format : uint32_t
+    {
+        OptionIndices,
+        BitsetDeltas
+    };
+
+    ~SolutionWriter()
+    {
+        Close();
+    }
+
+    // recordOptions is the most options a solution can have, which is only used by OptionIndices
+    bool Open(const char* fileName, int optionCount, int recordOptions, Format format = Format::OptionIndices)
+    {
+        Close();
+
+        if (fopen_s(&m_file, fileName, "wb") != 0 || !m_file)
+        {
+            printf("Could not open %s for writing\n", fileName);
+            m_file = nullptr;
+            return false;
+        }
+
+        m_fileName = fileName;
+        m_format = format;
+        m_optionCount = optionCount;
+        m_recordOptions = (format == Format::OptionIndices) ? recordOptions : 0;
+        m_wideIndices = optionCount > 0xFFFF;
+        m_recordBytes = RecordBytes(format, optionCount, m_recordOptions);
+        m_bits.assign((size_t(optionCount) + 63) / 64, 0);
+        m_previousBits.assign(m_bits.size(), 0);
+        m_solutionCount = 0;
+        m_error = false;
+        m_closing = false;
+
+        // The real header is written by Close, once the solution count is known
+        if (!WriteHeader())
+        {
+            printf("Could not write %s\n", fileName);
+            fclose(m_file);
+            m_file = nullptr;
+            return false;
+        }
+
+        m_freeBuffers.clear();
+        m_fullBuffers.clear();
+        m_buffers.resize(c_bufferCount);
+        for (std::vector<uint8_t>& buffer : m_buffers)
+        {
+            buffer.clear();
+            buffer.reserve(std::max(c_bufferSize, m_recordBytes));
+            m_freeBuffers.push_back(&buffer);
+        }
+        m_buffer = m_freeBuffers.front();
+        m_freeBuffers.pop_front();
+
+        m_thread = std::thread([this]() { WriterThread(); });
+        return true;
+    }
+
+    // Add a solution. Thread safe.
+    void Write(std::span<const int> optionIndices)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_file || m_closing)
+            return;
+
+        if (m_format == Format::OptionIndices && optionIndices.size() > size_t(m_recordOptions))
+        {
+            if (!m_error)
+                printf("A solution has %zu options, which is more than the %i that fit in a record of %s\n", optionIndices.size(), m_recordOptions, m_fileName.c_str());
+            m_error = true;
+            return;
+        }
+
+        for (int optionIndex : optionIndices)
+        {
+            if (optionIndex < 0 || optionIndex >= m_optionCount)
+            {
+                if (!m_error)
+                    printf("A solution has option %i, which isn't one of the %i options of %s\n", optionIndex, m_optionCount, m_fileName.c_str());
+                m_error = true;
+                return;
+            }
+        }
+
+        // Hand a full buffer to the writer thread, and wait for an empty one if they are all in use
+        if (m_buffer->size() + m_recordBytes > m_buffer->capacity())
+        {
+            m_fullBuffers.push_back(m_buffer);
+            m_condition.notify_all();
+            m_condition.wait(lock, [this]() { return !m_freeBuffers.empty(); });
+            m_buffer = m_freeBuffers.front();
+            m_freeBuffers.pop_front();
+        }
+
+        size_t offset = m_buffer->size();
+        m_buffer->resize(offset + m_recordBytes);
+        uint8_t* record = m_buffer->data() + offset;
+
+        if (m_format == Format::OptionIndices)
+        {
+            if (m_wideIndices)
+                WriteIndices<uint32_t>(record, optionIndices);
+            else
+                WriteIndices<uint16_t>(record, optionIndices);
+        }
+        else
+        {
+            std::fill(m_bits.begin(), m_bits.end(), 0);
+            for (int optionIndex : optionIndices)
+                m_bits[optionIndex / 64] |= uint64_t(1) << (optionIndex % 64);
+
+            for (size_t wordIndex = 0; wordIndex < m_bits.size(); ++wordIndex)
+            {
+                uint64_t delta = m_bits[wordIndex] ^ m_previousBits[wordIndex];
+                memcpy(record + wordIndex * sizeof(uint64_t), &delta, sizeof(delta));
+            }
+            m_bits.swap(m_previousBits);
+        }
+
+        m_solutionCount++;
+    }
+
+    // A solution lambda for Solve or SolveParallel that writes each solution
+    auto Sink()
+    {
+        return [this](const auto& solver, auto...) { Write(solver.SolutionOptions()); };
+    }
+
+    // Write what's left, and the header. Returns false if anything went wrong since Open.
+    bool Close()
+    {
+        if (!m_file)
+            return true;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_buffer->empty())
+                m_fullBuffers.push_back(m_buffer);
+            m_closing = true;
+            m_condition.notify_all();
+        }
+        m_thread.join();
+
+        bool ok = !m_error && fseek(m_file, 0, SEEK_SET) == 0 && WriteHeader();
+        ok = (fclose(m_file) == 0) && ok;
+        m_file = nullptr;
+
+        if (!ok)
+            printf("Could not write all of the solutions to %s\n", m_fileName.c_str());
+        return ok;
+    }
+
+    uint64_t SolutionCount() const
+    {
+        return m_solutionCount;
+    }
+
+    // The size of each record, which SolutionReader checks the header against
+    static size_t RecordBytes(Format format, int optionCount, int recordOptions)
+    {
+        if (format == Format::OptionIndices)
+            return size_t(recordOptions) * (optionCount > 0xFFFF ? sizeof(uint32_t) : sizeof(uint16_t));
+        return ((size_t(optionCount) + 63) / 64) * sizeof(uint64_t);
+    }
+
+private:
+    template <typename TOptionIndex>
+    void WriteIndices(uint8_t* record, std::span<const int> optionIndices)
+    {
+        TOptionIndex values[256];
+        size_t written = 0;
+        while (written < size_t(m_recordOptions))
+        {
+            size_t count = std::min(size_t(m_recordOptions) - written, _countof(values));
+            for (size_t index = 0; index < count; ++index)
+                values[index] = (written + index < optionIndices.size()) ? TOptionIndex(optionIndices[written + index]) : TOptionIndex(-1);
+            memcpy(record + written * sizeof(TOptionIndex), values, count * sizeof(TOptionIndex));
+            written += count;
+        }
+    }
+
+    bool WriteHeader()
+    {
+        uint32_t header[6] = { c_fileMagic, c_fileVersion, uint32_t(m_format), uint32_t(m_optionCount), uint32_t(m_recordOptions), uint32_t(m_recordBytes) };
+        uint64_t solutionCount = m_solutionCount;
+        return fwrite(header, sizeof(header), 1, m_file) == 1 && fwrite(&solutionCount, sizeof(solutionCount), 1, m_file) == 1;
+    }
+
+    // Write full buffers until closing, and then whatever is left
+    void WriterThread()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_condition.wait(lock, [this]() { return !m_fullBuffers.empty() || m_closing; });
+            if (m_fullBuffers.empty())
+                break;
+
+            std::vector<uint8_t>* buffer = m_fullBuffers.front();
+            m_fullBuffers.pop_front();
+
+            lock.unlock();
+            bool ok = fwrite(buffer->data(), 1, buffer->size(), m_file) == buffer->size();
+            buffer->clear();
+            lock.lock();
+
+            if (!ok)
+                m_error = true;
+            m_freeBuffers.push_back(buffer);
+            m_condition.notify_all();
+        }
+    }
+
+    FILE* m_file = nullptr;
+    std::string m_fileName;
+    Format m_format = Format::OptionIndices;
+    int m_optionCount = 0;
+    int m_recordOptions = 0;
+    bool m_wideIndices = false;
+    size_t m_recordBytes = 0;
+    uint64_t m_solutionCount = 0;
+    bool m_error = false;
+
+    // The bits of this solution and the one before, for BitsetDeltas
+    std::vector<uint64_t> m_bits;
+    std::vector<uint64_t> m_previousBits;
+
+    // m_buffer is being filled by Write. Full buffers wait for the writer thread, which gives them back as free buffers.
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::vector<std::vector<uint8_t>> m_buffers;
+    std::vector<uint8_t>* m_buffer = nullptr;
+    std::deque<std::vector<uint8_t>*> m_freeBuffers;
+    std::deque<std::vector<uint8_t>*> m_fullBuffers;
+    bool m_closing = false;
+    std::thread m_thread;
+};
+
+// Reads the solutions from a file made by SolutionWriter, one at a time
+class SolutionReader
+{
+public:
+    ~SolutionReader()
+    {
+        Close();
+    }
+
+    bool Open(const char* fileName)
+    {
+        Close();
+
+        if (fopen_s(&m_file, fileName, "rb") != 0 || !m_file)
+        {
+            printf("Could not open %s for reading\n", fileName);
+            m_file = nullptr;
+            return false;
+        }
+
+        uint32_t header[6] = {};
+        bool ok = fread(header, sizeof(header), 1, m_file) == 1 && header[0] == SolutionWriter::c_fileMagic && header[1] == SolutionWriter::c_fileVersion &&
+            header[2] <= uint32_t(SolutionWriter::Format::BitsetDeltas) && fread(&m_solutionCount, sizeof(m_solutionCount), 1, m_file) == 1;
+
+        // The counts have to fit in an int, BitsetDeltas doesn't have record options, and the record size has to be
+        // the one SolutionWriter would have used for them
+        if (ok)
+        {
+            SolutionWriter::Format format = SolutionWriter::Format(header[2]);
+            ok = header[3] <= uint32_t(std::numeric_limits<int>::max()) && header[4] <= uint32_t(std::numeric_limits<int>::max()) &&
+                (format == SolutionWriter::Format::OptionIndices || header[4] == 0) &&
+                SolutionWriter::RecordBytes(format, int(header[3]), int(header[4])) == size_t(header[5]) &&
+                (m_solutionCount == 0 || header[5] <= FileBytesLeft(m_file));
+        }
+        if (!ok)
+        {
+            printf("%s is not a valid solution file\n", fileName);
+            Close();
+            return false;
+        }
+
+        m_format = SolutionWriter::Format(header[2]);
+        m_optionCount = int(header[3]);
+        m_recordOptions = int(header[4]);
+        m_record.resize((m_solutionCount > 0) ? header[5] : 0);
+        m_bits.assign((m_format == SolutionWriter::Format::BitsetDeltas) ? m_record.size() / sizeof(uint64_t) : 0, 0);
+        m_solutionsRead = 0;
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_file)
+            fclose(m_file);
+        m_file = nullptr;
+    }
+
+    // Read the next solution's option indices. Returns false when there are no more.
+    bool Next(std::vector<int>& optionIndices)
+    {
+        optionIndices.clear();
+        if (!m_file || m_solutionsRead >= m_solutionCount || fread(m_record.data(), 1, m_record.size(), m_file) != m_record.size())
+            return false;
+        m_solutionsRead++;
+
+        if (m_format == SolutionWriter::Format::OptionIndices)
+        {
+            bool wideIndices = m_optionCount > 0xFFFF;
+            for (int index = 0; index < m_recordOptions; ++index)
+            {
+                uint32_t optionIndex = 0;
+                if (wideIndices)
+                {
+                    memcpy(&optionIndex, m_record.data() + index * sizeof(uint32_t), sizeof(uint32_t));
+                    if (optionIndex == 0xFFFFFFFF)
+                        break;
+                }
+                else
+                {
+                    uint16_t narrowIndex = 0;
+                    memcpy(&narrowIndex, m_record.data() + index * sizeof(uint16_t), sizeof(uint16_t));
+                    if (narrowIndex == 0xFFFF)
+                        break;
+                    optionIndex = narrowIndex;
+                }
+
+                // A record that doesn't fit the header ends the file
+                if (optionIndex >= uint32_t(m_optionCount))
+                {
+                    printf("A solution has option %u, which isn't one of the %i options of the file\n", optionIndex, m_optionCount);
+                    optionIndices.clear();
+                    Close();
+                    return false;
+                }
+                optionIndices.push_back(int(optionIndex));
+            }
+        }
+        else
+        {
+            for (size_t wordIndex = 0; wordIndex < m_bits.size(); ++wordIndex)
+            {
+                uint64_t delta = 0;
+                memcpy(&delta, m_record.data() + wordIndex * sizeof(uint64_t), sizeof(delta));
+                m_bits[wordIndex] ^= delta;
+
+                // Bits past the last option end the file, like option indices that don't fit do
+                if (wordIndex == m_bits.size() - 1 && (m_optionCount % 64) != 0 && (m_bits[wordIndex] >> (m_optionCount % 64)) != 0)
+                {
+                    printf("A solution has options past the %i options of the file\n", m_optionCount);
+                    optionIndices.clear();
+                    Close();
+                    return false;
+                }
+
+                for (uint64_t bits = m_bits[wordIndex]; bits; bits &= bits - 1)
+                    optionIndices.push_back(int(wordIndex * 64 + std::countr_zero(bits)));
+            }
+        }
+        return true;
+    }
+
+    uint64_t SolutionCount() const
+    {
+        return m_solutionCount;
+    }
+
+private:
+    FILE* m_file = nullptr;
+    SolutionWriter::Format m_format = SolutionWriter::Format::OptionIndices;
+    int m_optionCount = 0;
+    int m_recordOptions = 0;
+    uint64_t m_solutionCount = 0;
+    uint64_t m_solutionsRead = 0;
+    std::vector<uint8_t> m_record;
+    std::vector<uint64_t> m_bits;
+};
@@ -45,29 +45,37 @@ inline void Sudoku()
 
     // Name the items
     {
+        char name[32];
         for (int i = 0; i < 81; ++i)
         {
             int x = i % 9;
             int y = i / 9;
 
             // Cell(x,y) has an item or not
-            sprintf_s(solver.m_items[c_cellsBegin + i].name, "Cel%i_%i", x, y);
+            sprintf_s(name, "Cel%i_%i", x, y);
+            solver.SetItemName(c_cellsBegin + i, name);
 
             // Row(x) has item y or not
-            sprintf_s(solver.m_items[c_rowsBegin + i].name, "Row%i_%i", x, y);
+            sprintf_s(name, "Row%i_%i", x, y);
+            solver.SetItemName(c_rowsBegin + i, name);
 
             // Col(x) has item y or not
-            sprintf_s(solver.m_items[c_colsBegin + i].name, "Col%i_%i", x, y);
+            sprintf_s(name, "Col%i_%i", x, y);
+            solver.SetItemName(c_colsBegin + i, name);
 
             // Block(x) has item y or not
-            sprintf_s(solver.m_items[c_blocksBegin + i].name, "Blck%i_%i", x, y);
+            sprintf_s(name, "Blck%i_%i", x, y);
+            solver.SetItemName(c_blocksBegin + i, name);
         }
 
         // Initial state
-        sprintf_s(solver.m_items[c_initialState].name, "Init");
+        solver.SetItemName(c_initialState, "Init");
     }
 
-    // Make the 9 options for each 0 on the board
+    // Make the 9 options for each 0 on the board.
+    // Remember the cell and value of each option, to read solutions back.
+    std::vector<int> optionCells;
+    std::vector<int> optionValues;
     {
         int option[4];
         for (int cell = 0; cell < 9 * 9; ++cell)
@@ -89,13 +97,15 @@ inline void Sudoku()
                 option[2] = c_colsBegin + (cellX) * 9 + value;
                 option[3] = c_blocksBegin + (block) * 9 + value;
                 solver.AddOption(option);
+
+                optionCells.push_back(cell);
+                optionValues.push_back(value + 1);
             }
         }
     }
 
     // Make the initial state option
     // This is the only row which has the initial state item covered, so will always be part of the solution.
-    int initialStateOptionNodeIndex = 1 + (int)solver.m_nodes.size();
     {
         std::vector<int> initialState;
         for (int cell = 0; cell < 9 * 9; ++cell)
@@ -129,6 +139,10 @@ inline void Sudoku()
         solver.AddOption(initialState);
     }
 
+    // The initial state option is the only option of its item, and takes out the options that clash with the givens.
+    // Presolve takes it, and then fills in the cells and values that are forced by that, before searching.
+    solver.SetPresolve(true);
+
     // Solve and print out the solution
     int solutionCount = 0;
     std::vector<int> solvedBoard(81);
@@ -143,24 +157,13 @@ inline void Sudoku()
             solutionCount++;
             printf("Solution #%i...", solutionCount);
 
-            for (int optionIndex : solver.m_solutionOptionNodeIndices)
+            for (int optionIndex : solver.SolutionOptions())
             {
-                if (optionIndex == initialStateOptionNodeIndex)
+                // The initial state option was added last
+                if (optionIndex >= (int)optionCells.size())
                     continue;
 
-                // Find the spacer node for this option
-                int spacerNode = optionIndex;
-                while (solver.m_nodes[spacerNode].itemIndex != -1)
-                    spacerNode--;
-
-                // get the cell and value
-                int cell = solver.m_nodes[spacerNode + 1].itemIndex - c_cellsBegin;
-                int cellY = cell / 9;
-                int itemIndex = solver.m_nodes[spacerNode + 2].itemIndex;
-                int value = 1 + itemIndex - (c_rowsBegin + (cellY) * 9);
-
-                // set it
-                solvedBoard[cell] = value;
+                solvedBoard[optionCells[optionIndex]] = optionValues[optionIndex];
             }
 
             for (int cell = 0; cell < 81; ++cell)
@@ -178,4 +181,223 @@ inline void Sudoku()
             printf("\n\n");
         }
     );
-}
\ No newline at end of file
+}
+
+// The model for an empty Sudoku board, for solving many puzzles with.
+// There are 9 options per cell, and option index cell * 9 + (value - 1) puts value in that cell.
+// Puzzles select the options for their givens instead of adding an initial state option.
+inline Solver<true, false> MakeSudokuModel()
+{
+    // The 324 items are the same as in Sudoku(), without the initial state
+    static const int c_cellsBegin = 0;
+    static const int c_rowsBegin = c_cellsBegin + 81;
+    static const int c_colsBegin = c_rowsBegin + 81;
+    static const int c_blocksBegin = c_colsBegin + 81;
+    static const int c_numItems = c_blocksBegin + 81;
+
+    auto solver = Solver<true, false>::AddItems(c_numItems);
+    char name[32];
+    for (int i = 0; i < 81; ++i)
+    {
+        int x = i % 9;
+        int y = i / 9;
+        sprintf_s(name, "Cel%i_%i", x, y);
+        solver.SetItemName(c_cellsBegin + i, name);
+        sprintf_s(name, "Row%i_%i", x, y);
+        solver.SetItemName(c_rowsBegin + i, name);
+        sprintf_s(name, "Col%i_%i", x, y);
+        solver.SetItemName(c_colsBegin + i, name);
+        sprintf_s(name, "Blck%i_%i", x, y);
+        solver.SetItemName(c_blocksBegin + i, name);
+    }
+
+    solver.Reserve(81 * 9, 81 * 9 * 4);
+
+    int option[4];
+    for (int cell = 0; cell < 9 * 9; ++cell)
+    {
+        int cellX = cell % 9;
+        int cellY = cell / 9;
+        int block = (cellY / 3) * 3 + (cellX / 3);
+
+        option[0] = c_cellsBegin + cell;
+        for (int value = 0; value < 9; ++value)
+        {
+            option[1] = c_rowsBegin + (cellY) * 9 + value;
+            option[2] = c_colsBegin + (cellX) * 9 + value;
+            option[3] = c_blocksBegin + (block) * 9 + value;
+            solver.AddOption(option);
+        }
+    }
+
+    return solver;
+}
+
+// Read puzzles with one per line, as 81 characters of 1-9 for givens and 0 or . for empty cells.
+// Lines that aren't puzzles are skipped.
+inline std::vector<std::string> ReadSudokuPuzzles(const char* fileName)
+{
+    std::vector<std::string> puzzles;
+
+    FILE* file = nullptr;
+    if (fopen_s(&file, fileName, "rb") != 0 || !file)
+    {
+        printf("Could not open %s for reading\n", fileName);
+        return puzzles;
+    }
+
+    char line[256];
+    while (fgets(line, _countof(line), file))
+    {
+        size_t length = strcspn(line, "\r\n");
+        if (length == 81 && strspn(line, "0123456789.") == 81)
+            puzzles.emplace_back(line, 81);
+    }
+
+    fclose(file);
+    return puzzles;
+}
+
+// Solve puzzles in the format of ReadSudokuPuzzles, using threadCount threads (0 for one per hardware thread).
+// The model is made once, and each thread solves puzzles with its own copy of it, taking puzzles in small chunks.
+// solutions[i] is the solved board for puzzles[i] in the same format, or empty if it has no solution.
+// solutionCounts[i] is 0, 1, or 2 for more than one solution, so puzzles that aren't proper can be found.
+inline void SolveSudokus(const std::vector<std::string>& puzzles, std::vector<std::string>& solutions, std::vector<size_t>& solutionCounts, int threadCount)
+{
+    solutions.assign(puzzles.size(), std::string());
+    solutionCounts.assign(puzzles.size(), 0);
+
+    auto baseSolver = MakeSudokuModel();
+    if (!baseSolver.Seal())
+        return;
+
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+
+    static const size_t c_puzzlesPerChunk = 64;
+    std::atomic<size_t> nextPuzzle = 0;
+
+    auto Worker = [&]()
+    {
+        auto solver = baseSolver;
+        while (true)
+        {
+            size_t chunkBegin = nextPuzzle.fetch_add(c_puzzlesPerChunk);
+            if (chunkBegin >= puzzles.size())
+                break;
+
+            size_t chunkEnd = std::min(chunkBegin + c_puzzlesPerChunk, puzzles.size());
+            for (size_t puzzleIndex = chunkBegin; puzzleIndex < chunkEnd; ++puzzleIndex)
+            {
+                // Select the options for the givens. If two givens conflict, there is no solution.
+                const std::string& puzzle = puzzles[puzzleIndex];
+                bool valid = true;
+                for (int cell = 0; cell < 81 && valid; ++cell)
+                {
+                    if (puzzle[cell] >= '1' && puzzle[cell] <= '9')
+                        valid = solver.SelectOption(cell * 9 + (puzzle[cell] - '1'));
+                }
+
+                if (valid)
+                {
+                    // Stop at a second solution, which is enough to know that the puzzle isn't proper
+                    solver.SolveSelected([&](const auto& solver)
+                        {
+                            if (solver.m_solutionsFound > 1)
+                                return;
+
+                            std::string& solution = solutions[puzzleIndex];
+                            solution.resize(81);
+                            for (int optionIndex : solver.SolutionOptions())
+                                solution[optionIndex / 9] = char('1' + optionIndex % 9);
+                        },
+                        2
+                    );
+                    solutionCounts[puzzleIndex] = solver.m_solutionsFound;
+                }
+
+                solver.UnselectOptions();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int workerId = 1; workerId < threadCount; ++workerId)
+        threads.emplace_back(Worker);
+    Worker();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// Solve a file of puzzles, and report how many had a unique solution and how fast it went
+inline void SudokuBatch(const std::vector<std::string>& puzzles, int threadCount)
+{
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    std::vector<std::string> solutions;
+    std::vector<size_t> solutionCounts;
+    SolveSudokus(puzzles, solutions, solutionCounts, threadCount);
+    std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - start);
+
+    size_t counts[3] = {};
+    for (size_t solutionCount : solutionCounts)
+        counts[std::min(solutionCount, size_t(2))]++;
+
+    printf("%zu puzzles: %zu with one solution, %zu with more than one, %zu with none\n", puzzles.size(), counts[1], counts[2], counts[0]);
+    printf("%0.3f seconds using %i threads, %0.0f puzzles per second\n\n", timeSpan.count(), threadCount, double(puzzles.size()) / std::max(timeSpan.count(), 1e-9));
+}
+
+inline void SudokuBatch(const char* fileName, int threadCount)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%s)\n", fileName);
+    printf("===========================================\n");
+
+    SudokuBatch(ReadSudokuPuzzles(fileName), threadCount);
+}
+
+// Benchmark the batch solver with puzzles made from the board in Sudoku() by shuffling the digits,
+// shuffling rows within bands and the bands themselves, and transposing. These all keep a puzzle proper.
+inline void SudokuBenchmark(int puzzleCount, int threadCount)
+{
+    printf("===========================================\n");
+    printf(__FUNCTION__ "(%i)\n", puzzleCount);
+    printf("===========================================\n");
+
+    static const char c_board[] = "530070000600195000098000060800060003400803001700020006060000280000419005000080079";
+
+    std::mt19937 rng = GetRNG();
+    std::vector<std::string> puzzles(puzzleCount);
+    for (std::string& puzzle : puzzles)
+    {
+        int digits[10] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+        std::shuffle(&digits[1], &digits[10], rng);
+
+        int bands[3] = { 0, 1, 2 };
+        std::shuffle(&bands[0], &bands[3], rng);
+
+        int rows[9];
+        for (int band = 0; band < 3; ++band)
+        {
+            int bandRows[3] = { 0, 1, 2 };
+            std::shuffle(&bandRows[0], &bandRows[3], rng);
+            for (int i = 0; i < 3; ++i)
+                rows[band * 3 + i] = bands[band] * 3 + bandRows[i];
+        }
+
+        bool transpose = (rng() & 1) != 0;
+
+        puzzle.resize(81);
+        for (int cell = 0; cell < 81; ++cell)
+        {
+            int x = cell % 9;
+            int y = rows[cell / 9];
+            int sourceCell = transpose ? (x * 9 + y) : (y * 9 + x);
+            puzzle[cell] = char('0' + digits[c_board[sourceCell] - '0']);
+        }
+    }
+
+    SudokuBatch(puzzles, threadCount);
+}
@@ -1,15 +1,38 @@
 // Indices are used instead of pointers because they don't invalidate when dynamic arrays resize.
 // Knuth also notes that you can use types that are smaller than a pointer type when they are indices.
 // I didn't do things quite as bare metal efficient as Knuth, so check out his code if you want to squeeze out more perf!
-// For instance, his implementation does not use recursive functions, while mine does.
+// The search itself is a loop over an explicit per level stack, like Knuth's, rather than recursive function calls.
 
+#include <cstdio>
 #include <vector>
+#include <limits>
+#include <cstdint>
 #include <algorithm>
 #include <random>
 #include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <cstdlib>
+#include <utility>
+#include <bit>
+#include <atomic>
+#include <iterator>
+#include <stop_token>
+#include <type_traits>
+#include <condition_variable>
+#include <cstring>
+#include <cmath>
 
 #define DETERMINISTIC() false
 #define PRINT_PROGRESS_RATE() 1000000
+#define PRINT_PRESOLVE() false
+
+// Small exact cover problems without colors or multiplicities get solved with bitsets instead of dancing links
+#define USE_BIT_SOLVER() true
 
 std::mt19937 GetRNG()
 {
@@ -22,62 +45,524 @@ std::mt19937 GetRNG()
     return rng;
 }
 
-// An item is something to be covered
+// SplitMix64, a small and fast random number generator for the randomized search, which takes a random number for
+// every option it tries. Seeded from GetRNG(), so DETERMINISTIC() applies to it too.
+struct FastRNG
+{
+    FastRNG(uint64_t seed = 0)
+        : state(seed)
+    {
+    }
+
+    uint64_t Next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // A random number in [0, count), using a multiply and a shift instead of a divide
+    uint32_t Below(uint32_t count)
+    {
+        return uint32_t((uint64_t(uint32_t(Next() >> 32)) * count) >> 32);
+    }
+
+    uint64_t state;
+};
+
+FastRNG GetFastRNG()
+{
+    std::mt19937 rng = GetRNG();
+    return FastRNG((uint64_t(rng()) << 32) | rng());
+}
+
+// How many bytes of a file are left to read. Counts read from a file are checked against this before anything is
+// allocated for them, so a corrupted count fails the read instead of asking for more memory than there is.
+size_t FileBytesLeft(FILE* file)
+{
+    long position = ftell(file);
+    if (position < 0 || fseek(file, 0, SEEK_END) != 0)
+        return 0;
+
+    long end = ftell(file);
+    if (fseek(file, position, SEEK_SET) != 0 || end < position)
+        return 0;
+    return size_t(end - position);
+}
+
+#include "BitSolver.h"
+#include "SearchStats.h"
+#include "SolutionWriter.h"
+
+// An item is something to be covered.
+// Only the fields touched while searching are in here. Names are kept separately, in ItemName.
+template <typename TIndex>
 struct Item
+{
+    TIndex leftItemIndex = TIndex(-1);
+    TIndex rightItemIndex = TIndex(-1);
+    TIndex optionCount = TIndex(-1);
+};
+
+// How many more options can still cover a primary item, and how many of those are optional.
+// A primary item that must be covered between lo and hi times starts with bound = hi and slack = hi - lo.
+// These are only kept for models with multiplicities, so that plain exact cover items stay small.
+template <typename TIndex>
+struct ItemBounds
+{
+    TIndex bound = 1;
+    TIndex slack = 0;
+};
+
+// Item names are only needed for building and printing, so they live in their own array
+struct ItemName
 {
     char name[8];
-    int leftItemIndex = -1;
-    int rightItemIndex = -1;
-    int optionCount = -1;
 };
 
 // An option is a sequential list of nodes.
+// TIndex is the type used for indices. Smaller index types make for smaller nodes, so more of them fit in cache.
+template <typename TIndex>
 struct Node
 {
     // Spacer nodes use upNodeIndex as the index of the previous spacer node, and downNodeIndex as the next spacer node.
     // Non spacer nodes use these to get to the next option for the current item
-    int upNodeIndex = -1;
-    int downNodeIndex = -1;
+    TIndex upNodeIndex = TIndex(-1);
+    TIndex downNodeIndex = TIndex(-1);
 
-    // What item a node belongs to.
-    // -1 means it is a spacer node.
+    // What item a node belongs to, which is Knuth's TOP field.
+    // TIndex(-1) means it is a spacer node.
     // There is a spacer node before and after every option.
     // An option is a sequential list of nodes.
-    int itemIndex = -1;
+    TIndex itemIndex = TIndex(-1);
+};
+
+#include "ItemHeuristics.h"
+
+// An unsigned integer that grows as needed, for solution counts that don't fit in 64 bits
+struct BigCount
+{
+    BigCount(uint64_t value = 0)
+    {
+        while (value)
+        {
+            words.push_back(uint32_t(value));
+            value >>= 32;
+        }
+    }
+
+    BigCount& operator+=(const BigCount& other)
+    {
+        if (words.size() < other.words.size())
+            words.resize(other.words.size(), 0);
+
+        uint64_t carry = 0;
+        for (size_t index = 0; index < words.size(); ++index)
+        {
+            if (index >= other.words.size() && carry == 0)
+                break;
+
+            uint64_t sum = uint64_t(words[index]) + carry + ((index < other.words.size()) ? other.words[index] : 0);
+            words[index] = uint32_t(sum);
+            carry = sum >> 32;
+        }
+
+        if (carry)
+            words.push_back(uint32_t(carry));
+        return *this;
+    }
+
+    // Make a decimal string by dividing by a billion over and over, getting 9 digits at a time
+    std::string ToString() const
+    {
+        std::string ret;
+        std::vector<uint32_t> quotient = words;
+        while (!quotient.empty())
+        {
+            uint64_t remainder = 0;
+            for (size_t index = quotient.size(); index-- > 0;)
+            {
+                uint64_t value = (remainder << 32) | quotient[index];
+                quotient[index] = uint32_t(value / 1000000000);
+                remainder = value % 1000000000;
+            }
+
+            while (!quotient.empty() && quotient.back() == 0)
+                quotient.pop_back();
+
+            char buffer[16];
+            sprintf_s(buffer, quotient.empty() ? "%u" : "%09u", uint32_t(remainder));
+            ret = buffer + ret;
+        }
+
+        return ret.empty() ? "0" : ret;
+    }
+
+    // Least significant word first
+    std::vector<uint32_t> words;
+};
+
+// A zero-suppressed decision diagram (ZDD) of a set of solutions, like the output of Knuth's DXZ.
+// Node 0 means no solutions, and node 1 means the single empty solution.
+// Every other node means the solutions in hi with the node's option added to each, plus the solutions in lo.
+// Nodes only point to nodes before them, so they can be processed in order.
+struct SolutionZdd
+{
+    struct Node
+    {
+        int32_t option = -1;
+        uint32_t lo = 0;
+        uint32_t hi = 0;
+    };
+
+    static const uint32_t c_fileMagic = 0x5A444458; // "XDDZ"
+    static const uint32_t c_fileVersion = 1;
+
+    std::vector<Node> nodes = { Node{ -1, 0, 0 }, Node{ -1, 1, 1 } };
+    uint32_t root = 0;
+
+    BigCount Count() const
+    {
+        std::vector<BigCount> counts(nodes.size());
+        counts[1] = 1;
+        for (size_t nodeIndex = 2; nodeIndex < nodes.size(); ++nodeIndex)
+        {
+            counts[nodeIndex] = counts[nodes[nodeIndex].lo];
+            counts[nodeIndex] += counts[nodes[nodeIndex].hi];
+        }
+        return counts[root];
+    }
+
+    // Calls lambda(std::span<const int> options) for each solution
+    template <typename TSolutionLambdaFN>
+    void ForEachSolution(const TSolutionLambdaFN& solutionLambda) const
+    {
+        std::vector<int> options;
+        ForEachSolution(root, options, solutionLambda);
+    }
+
+    // The file is a header of 4 uint32s (magic, version, node count, root) followed by the nodes
+    bool WriteToFile(const char* fileName) const
+    {
+        FILE* file = nullptr;
+        if (fopen_s(&file, fileName, "wb") != 0 || !file)
+        {
+            printf("Could not open %s for writing\n", fileName);
+            return false;
+        }
+
+        uint32_t header[4] = { c_fileMagic, c_fileVersion, uint32_t(nodes.size()), root };
+        bool ok = fwrite(header, sizeof(header), 1, file) == 1 && fwrite(nodes.data(), sizeof(Node), nodes.size(), file) == nodes.size();
+        ok = (fclose(file) == 0) && ok;
+        if (!ok)
+            printf("Could not write %s\n", fileName);
+        return ok;
+    }
+
+    bool ReadFromFile(const char* fileName)
+    {
+        FILE* file = nullptr;
+        if (fopen_s(&file, fileName, "rb") != 0 || !file)
+        {
+            printf("Could not open %s for reading\n", fileName);
+            return false;
+        }
+
+        uint32_t header[4] = {};
+        bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == c_fileMagic && header[1] == c_fileVersion && header[2] >= 2 && header[3] < header[2] &&
+            header[2] <= FileBytesLeft(file) / sizeof(Node);
+        if (ok)
+        {
+            nodes.resize(header[2]);
+            root = header[3];
+            ok = fread(nodes.data(), sizeof(Node), nodes.size(), file) == nodes.size();
+        }
+        fclose(file);
+
+        // Make sure the nodes only point backwards, so nothing else needs to check
+        for (size_t nodeIndex = 2; ok && nodeIndex < nodes.size(); ++nodeIndex)
+            ok = nodes[nodeIndex].lo < nodeIndex && nodes[nodeIndex].hi < nodeIndex;
+
+        if (!ok)
+        {
+            printf("%s is not a valid solution ZDD file\n", fileName);
+            *this = SolutionZdd();
+        }
+        return ok;
+    }
+
+private:
+    // Go down the lo chain, adding each node's option for the solutions in its hi
+    template <typename TSolutionLambdaFN>
+    void ForEachSolution(uint32_t nodeIndex, std::vector<int>& options, const TSolutionLambdaFN& solutionLambda) const
+    {
+        for (; nodeIndex > 1; nodeIndex = nodes[nodeIndex].lo)
+        {
+            options.push_back(nodes[nodeIndex].option);
+            ForEachSolution(nodes[nodeIndex].hi, options, solutionLambda);
+            options.pop_back();
+        }
+
+        if (nodeIndex == 1)
+            solutionLambda(std::span<const int>(options));
+    }
+};
+
+// Where an exhaustive search is, so it can be picked up again later, maybe in another process.
+// optionNumbers has the option number each level is trying, and the last level is about to try its option number.
+// The model's sizes are kept too, so a checkpoint isn't used with a different model by mistake.
+struct SearchCheckpoint
+{
+    static const uint32_t c_fileMagic = 0x4B584C44; // "DLXK"
+    static const uint32_t c_fileVersion = 1;
+
+    // About 30 years. Searches don't run that long, and the start time a resumed search works out from its seconds
+    // has to fit in the clock.
+    static constexpr double c_maxSeconds = 1.0e9;
+
+    uint32_t itemCount = 0;
+    uint32_t optionCount = 0;
+    uint32_t nodeCount = 0;
+    bool finished = false;
+    uint64_t solutionsFound = 0;
+    uint64_t attempts = 0;
+    int32_t maxRecursionDepth = 0;
+    double seconds = 0.0;
+    std::vector<int32_t> optionNumbers;
+
+    // The file is a header of 7 uint32s (magic, version, item count, option count, node count, finished, max recursion
+    // depth), 2 uint64s (solutions found, attempts), a double of seconds, a uint32 path length and the path.
+    // It's written to a temporary file first, so being stopped while writing leaves the last checkpoint alone.
+    bool WriteToFile(const char* fileName) const
+    {
+        std::string tempFileName = std::string(fileName) + ".tmp";
+        FILE* file = nullptr;
+        if (fopen_s(&file, tempFileName.c_str(), "wb") != 0 || !file)
+        {
+            printf("Could not open %s for writing\n", tempFileName.c_str());
+            return false;
+        }
+
+        uint32_t header[7] = { c_fileMagic, c_fileVersion, itemCount, optionCount, nodeCount, finished ? 1u : 0u, uint32_t(maxRecursionDepth) };
+        uint64_t counts[2] = { solutionsFound, attempts };
+        uint32_t pathLength = uint32_t(optionNumbers.size());
+        bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+            fwrite(counts, sizeof(counts), 1, file) == 1 &&
+            fwrite(&seconds, sizeof(seconds), 1, file) == 1 &&
+            fwrite(&pathLength, sizeof(pathLength), 1, file) == 1 &&
+            fwrite(optionNumbers.data(), sizeof(int32_t), optionNumbers.size(), file) == optionNumbers.size();
+        ok = (fclose(file) == 0) && ok;
+
+        // rename won't replace a file on every platform
+        if (ok)
+        {
+            std::remove(fileName);
+            ok = std::rename(tempFileName.c_str(), fileName) == 0;
+        }
+
+        if (!ok)
+            printf("Could not write %s\n", fileName);
+        return ok;
+    }
+
+    bool ReadFromFile(const char* fileName)
+    {
+        FILE* file = nullptr;
+        if (fopen_s(&file, fileName, "rb") != 0 || !file)
+        {
+            printf("Could not open %s for reading\n", fileName);
+            return false;
+        }
+
+        uint32_t header[7] = {};
+        uint64_t counts[2] = {};
+        uint32_t pathLength = 0;
+        bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == c_fileMagic && header[1] == c_fileVersion &&
+            fread(counts, sizeof(counts), 1, file) == 1 &&
+            fread(&seconds, sizeof(seconds), 1, file) == 1 &&
+            std::isfinite(seconds) && seconds >= 0.0 && seconds <= c_maxSeconds &&
+            fread(&pathLength, sizeof(pathLength), 1, file) == 1 && pathLength <= header[3] + header[2] + 1 &&
+            pathLength <= FileBytesLeft(file) / sizeof(int32_t);
+        if (ok)
+        {
+            itemCount = header[2];
+            optionCount = header[3];
+            nodeCount = header[4];
+            finished = header[5] != 0;
+            maxRecursionDepth = int32_t(header[6]);
+            solutionsFound = counts[0];
+            attempts = counts[1];
+            optionNumbers.resize(pathLength);
+            ok = fread(optionNumbers.data(), sizeof(int32_t), optionNumbers.size(), file) == optionNumbers.size();
+        }
+        fclose(file);
+
+        if (!ok)
+        {
+            printf("%s is not a valid search checkpoint file\n", fileName);
+            *this = SearchCheckpoint();
+        }
+        return ok;
+    }
 };
 
-struct SScopedRecursionCounter
+// The counts from searching some of the shards of a search tree. Shards of the same search can be run in different
+// processes or on different machines, and their counts merged to get the counts of the whole search.
+struct ShardCounts
 {
-    SScopedRecursionCounter()
+    static const uint32_t c_fileMagic = 0x53584C44; // "DLXS"
+    static const uint32_t c_fileVersion = 1;
+
+    // What was split into shards, and how
+    uint32_t itemCount = 0;
+    uint32_t optionCount = 0;
+    uint32_t nodeCount = 0;
+    uint32_t splitLevel = 0;
+    uint32_t shardCount = 0;
+
+    // Which shards these counts are for, and if any of them were stopped early by a search limit
+    std::vector<uint32_t> shardIndices;
+    bool stopped = false;
+
+    uint64_t solutionsFound = 0;
+    uint64_t attempts = 0;
+    int32_t maxRecursionDepth = 0;
+
+    // True once the counts of every shard are in, so the counts are of the whole search
+    bool IsComplete() const
+    {
+        return shardCount > 0 && shardIndices.size() == shardCount && !stopped;
+    }
+
+    // Add the counts of other shards of the same search. Returns false if they are from a different search, or
+    // have shards that are already in.
+    bool Merge(const ShardCounts& other)
     {
-        s_recursionLevel++;
+        if (shardIndices.empty())
+        {
+            *this = other;
+            return true;
+        }
+
+        if (other.itemCount != itemCount || other.optionCount != optionCount || other.nodeCount != nodeCount || other.splitLevel != splitLevel || other.shardCount != shardCount)
+        {
+            printf("Can't merge shard counts from different searches\n");
+            return false;
+        }
+
+        for (uint32_t shardIndex : other.shardIndices)
+        {
+            if (std::find(shardIndices.begin(), shardIndices.end(), shardIndex) != shardIndices.end())
+            {
+                printf("Shard %u was merged in twice\n", shardIndex);
+                return false;
+            }
+        }
+
+        shardIndices.insert(shardIndices.end(), other.shardIndices.begin(), other.shardIndices.end());
+        std::sort(shardIndices.begin(), shardIndices.end());
+        stopped = stopped || other.stopped;
+        solutionsFound += other.solutionsFound;
+        attempts += other.attempts;
+        maxRecursionDepth = std::max(maxRecursionDepth, other.maxRecursionDepth);
+        return true;
     }
 
-    ~SScopedRecursionCounter()
+    // The file is a header of 8 uint32s (magic, version, item count, option count, node count, split level,
+    // shard count, stopped), 2 uint64s (solutions found, attempts), an int32 max recursion depth, and a uint32 count
+    // of shard indices followed by the shard indices.
+    bool WriteToFile(const char* fileName) const
     {
-        s_recursionLevel--;
+        FILE* file = nullptr;
+        if (fopen_s(&file, fileName, "wb") != 0 || !file)
+        {
+            printf("Could not open %s for writing\n", fileName);
+            return false;
+        }
+
+        uint32_t header[8] = { c_fileMagic, c_fileVersion, itemCount, optionCount, nodeCount, splitLevel, shardCount, stopped ? 1u : 0u };
+        uint64_t counts[2] = { solutionsFound, attempts };
+        uint32_t shardIndexCount = uint32_t(shardIndices.size());
+        bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+            fwrite(counts, sizeof(counts), 1, file) == 1 &&
+            fwrite(&maxRecursionDepth, sizeof(maxRecursionDepth), 1, file) == 1 &&
+            fwrite(&shardIndexCount, sizeof(shardIndexCount), 1, file) == 1 &&
+            fwrite(shardIndices.data(), sizeof(uint32_t), shardIndices.size(), file) == shardIndices.size();
+        ok = (fclose(file) == 0) && ok;
+        if (!ok)
+            printf("Could not write %s\n", fileName);
+        return ok;
     }
 
-    static int s_recursionLevel;
+    bool ReadFromFile(const char* fileName)
+    {
+        FILE* file = nullptr;
+        if (fopen_s(&file, fileName, "rb") != 0 || !file)
+        {
+            printf("Could not open %s for reading\n", fileName);
+            return false;
+        }
+
+        uint32_t header[8] = {};
+        uint64_t counts[2] = {};
+        uint32_t shardIndexCount = 0;
+        bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == c_fileMagic && header[1] == c_fileVersion &&
+            fread(counts, sizeof(counts), 1, file) == 1 &&
+            fread(&maxRecursionDepth, sizeof(maxRecursionDepth), 1, file) == 1 &&
+            fread(&shardIndexCount, sizeof(shardIndexCount), 1, file) == 1 && shardIndexCount <= header[6] &&
+            shardIndexCount <= FileBytesLeft(file) / sizeof(uint32_t);
+        if (ok)
+        {
+            itemCount = header[2];
+            optionCount = header[3];
+            nodeCount = header[4];
+            splitLevel = header[5];
+            shardCount = header[6];
+            stopped = header[7] != 0;
+            solutionsFound = counts[0];
+            attempts = counts[1];
+            shardIndices.resize(shardIndexCount);
+            ok = fread(shardIndices.data(), sizeof(uint32_t), shardIndices.size(), file) == shardIndices.size();
+        }
+        fclose(file);
+
+        for (size_t index = 0; ok && index < shardIndices.size(); ++index)
+            ok = shardIndices[index] < shardCount;
+
+        if (!ok)
+        {
+            printf("%s is not a valid shard counts file\n", fileName);
+            *this = ShardCounts();
+        }
+        return ok;
+    }
 };
-int SScopedRecursionCounter::s_recursionLevel = -1;
 
-template <bool EXHAUSTIVE, bool SHOW_ALL_ATTEMPTS = false>
+// TSearchStats is an instrumentation policy from SearchStats.h. The default, NoSearchStats, costs nothing.
+// TItemHeuristic chooses which item to branch on, from ItemHeuristics.h. The default is MrvHeuristic.
+template <bool EXHAUSTIVE, bool SHOW_ALL_ATTEMPTS = false, typename TIndex = int, typename TSearchStats = NoSearchStats, typename TItemHeuristic = MrvHeuristic>
 class Solver
 {
 public:
 
+    // The item index of spacer nodes
+    static constexpr TIndex c_spacer = TIndex(-1);
+
     // Add items without names, that are named later by the caller
     static Solver AddItems(int count, int firstOptionalItem = -1)
     {
         // Add the items. The caller needs to name them later.
         Solver ret;
+        if (!ret.CheckIndexRange(size_t(count) + 1))
+            return ret;
         ret.m_items.resize(count);
+        ret.m_itemNames.resize(count);
 
         // Add a root node item to the end
         ret.m_rootItemIndex = (int)ret.m_items.size();
         ret.m_items.resize(ret.m_items.size() + 1);
-        ret.m_items[ret.m_rootItemIndex].name[0] = 0;
+        ret.m_itemNames.resize(ret.m_items.size());
         if (firstOptionalItem < 0)
             ret.m_firstOptionalItem = ret.m_rootItemIndex;
         else
@@ -86,29 +571,38 @@ public:
         // make the doubly linked list of items
         for (int index = 0; index < (int)ret.m_items.size(); ++index)
         {
-            ret.m_items[index].leftItemIndex = int((index + ret.m_items.size() - 1) % ret.m_items.size());
-            ret.m_items[index].rightItemIndex = int((index + 1) % ret.m_items.size());
+            ret.m_items[index].leftItemIndex = TIndex((index + ret.m_items.size() - 1) % ret.m_items.size());
+            ret.m_items[index].rightItemIndex = TIndex((index + 1) % ret.m_items.size());
         }
 
         // Make a node for each item except the root node
         ret.m_nodes.resize(ret.m_items.size() - 1);
         for (int index = 0; index < (int)ret.m_nodes.size(); ++index)
         {
-            ret.m_nodes[index].upNodeIndex = index;
-            ret.m_nodes[index].downNodeIndex = index;
-            ret.m_nodes[index].itemIndex = index;
+            ret.m_nodes[index].upNodeIndex = TIndex(index);
+            ret.m_nodes[index].downNodeIndex = TIndex(index);
+            ret.m_nodes[index].itemIndex = TIndex(index);
         }
+        ret.m_nodeOptionIndices.resize(ret.m_nodes.size(), -1);
+        ret.m_nodeColors.resize(ret.m_nodes.size(), 0);
 
         return ret;
     }
 
-    // Comma seperated list
+    // Comma seperated list.
+    // Primary items can be given multiplicities like Knuth's DLX3 with "lo:hi|name", or "count|name" for lo = hi.
     static Solver AddItems(const char* itemNames, int firstOptionalItem = -1)
     {
         // Parse and add the items
         Solver ret;
+        std::vector<std::pair<int, int>> multiplicities;
         if (itemNames)
         {
+            size_t itemCount = std::count(itemNames, itemNames + strlen(itemNames), ',') + 1;
+            ret.m_items.reserve(itemCount + 1);
+            ret.m_itemNames.reserve(itemCount + 1);
+            multiplicities.reserve(itemCount);
+
             const char* start = itemNames;
             while (true)
             {
@@ -116,17 +610,38 @@ public:
                 if (!end)
                     end = &start[strlen(start)];
 
-                Item newItem;
-                if (end - start >= _countof(newItem.name))
+                const char* bar = (const char*)memchr(start, '|', end - start);
+                if (bar)
+                {
+                    char* numberEnd = nullptr;
+                    int lo = (int)strtol(start, &numberEnd, 10);
+                    int hi = (numberEnd[0] == ':') ? (int)strtol(numberEnd + 1, &numberEnd, 10) : lo;
+                    if (numberEnd != bar)
+                    {
+                        printf("item %i has a bad multiplicity, it should look like \"lo:hi|name\" or \"count|name\"\n", (int)ret.m_items.size());
+                        ret.m_error = true;
+                        return ret;
+                    }
+                    multiplicities.emplace_back(lo, hi);
+                    start = &bar[1];
+                }
+                else
+                {
+                    multiplicities.emplace_back(1, 1);
+                }
+
+                ItemName newItemName;
+                if (size_t(end - start) >= _countof(newItemName.name))
                 {
-                    printf("item %i name is too long, max length is %i\n", (int)ret.m_items.size(), (int)_countof(newItem.name) - 1);
+                    printf("item %i name is too long, max length is %i\n", (int)ret.m_items.size(), (int)_countof(newItemName.name) - 1);
                     ret.m_error = true;
                     return ret;
                 }
 
-                memcpy(newItem.name, start, (end - start));
-                newItem.name[end - start] = 0;
-                ret.m_items.push_back(newItem);
+                memcpy(newItemName.name, start, (end - start));
+                newItemName.name[end - start] = 0;
+                ret.m_itemNames.push_back(newItemName);
+                ret.m_items.emplace_back();
 
                 if (end[0] == 0)
                     break;
@@ -143,10 +658,13 @@ public:
             return ret;
         }
 
+        if (!ret.CheckIndexRange(ret.m_items.size() + 1))
+            return ret;
+
         // Add a root node item to the end
         ret.m_rootItemIndex = (int)ret.m_items.size();
         ret.m_items.resize(ret.m_items.size() + 1);
-        ret.m_items[ret.m_rootItemIndex].name[0] = 0;
+        ret.m_itemNames.resize(ret.m_items.size());
         if (firstOptionalItem < 0)
             ret.m_firstOptionalItem = ret.m_rootItemIndex;
         else
@@ -155,543 +673,3218 @@ public:
         // make the doubly linked list of items
         for (int index = 0; index < (int)ret.m_items.size(); ++index)
         {
-            ret.m_items[index].leftItemIndex = int((index + ret.m_items.size() - 1) % ret.m_items.size());
-            ret.m_items[index].rightItemIndex = int((index + 1) % ret.m_items.size());
+            ret.m_items[index].leftItemIndex = TIndex((index + ret.m_items.size() - 1) % ret.m_items.size());
+            ret.m_items[index].rightItemIndex = TIndex((index + 1) % ret.m_items.size());
         }
 
         // Make a node for each item except the root node
         ret.m_nodes.resize(ret.m_items.size() - 1);
         for (int index = 0; index < (int)ret.m_nodes.size(); ++index)
         {
-            ret.m_nodes[index].upNodeIndex = index;
-            ret.m_nodes[index].downNodeIndex = index;
-            ret.m_nodes[index].itemIndex = index;
+            ret.m_nodes[index].upNodeIndex = TIndex(index);
+            ret.m_nodes[index].downNodeIndex = TIndex(index);
+            ret.m_nodes[index].itemIndex = TIndex(index);
+        }
+        ret.m_nodeOptionIndices.resize(ret.m_nodes.size(), -1);
+        ret.m_nodeColors.resize(ret.m_nodes.size(), 0);
+
+        for (int index = 0; index < (int)multiplicities.size(); ++index)
+        {
+            if (multiplicities[index] != std::make_pair(1, 1))
+                ret.SetItemMultiplicity(index, multiplicities[index].first, multiplicities[index].second);
         }
 
         return ret;
     }
 
-    // integers
-    Solver& AddOption(const int* ints, size_t count)
+    // Knuth's text format, which dlx1, dlx2 and dlx3 read. Blank lines, and lines where the first thing is '|', are
+    // skipped. The first line has the item names separated by spaces, with a '|' between the primary and secondary
+    // items, and primary items can have multiplicities like "lo:hi|name". Each line after that is an option, with
+    // colors on secondary items like "name:color".
+    static Solver FromDlxText(const char* text)
     {
-        m_optionCount++;
-        int spacerNodeIndex = (int)m_nodes.size();
-
-        // Add a spacer node
-        {
-            m_nodes.resize(m_nodes.size() + 1 + count);
-            Node& newNode = m_nodes[spacerNodeIndex];
-            newNode.itemIndex = -1;
-        }
-
-        for (int i = 0; i < (int)count; ++i)
+        // Call lineLambda(lineNumber, tokens) for each line that isn't skipped, with the tokens separated by commas.
+        // Stops and returns false if lineLambda does.
+        std::string tokens;
+        auto ForEachLine = [&](const auto& lineLambda)
         {
-            int itemIndex = ints[i];
+            int lineNumber = 0;
+            for (const char* line = text; line[0]; )
+            {
+                const char* lineEnd = strchr(line, '\n');
+                if (!lineEnd)
+                    lineEnd = &line[strlen(line)];
+                lineNumber++;
 
-            // Make a new node
-            int newNodeIndex = spacerNodeIndex + 1 + i;
-            Node& newNode = m_nodes[newNodeIndex];
-            newNode.itemIndex = itemIndex;
+                tokens.clear();
+                for (const char* c = line; c < lineEnd; )
+                {
+                    while (c < lineEnd && isspace((unsigned char)*c))
+                        c++;
+                    const char* tokenStart = c;
+                    while (c < lineEnd && !isspace((unsigned char)*c))
+                        c++;
 
-            // hook it into the doubly linked list for the item.  Put it at the end of the list
-            Node& itemNode = m_nodes[itemIndex];
-            newNode.upNodeIndex = itemNode.upNodeIndex;
-            newNode.downNodeIndex = itemIndex;
-            m_nodes[newNode.upNodeIndex].downNodeIndex = newNodeIndex;
-            m_nodes[newNode.downNodeIndex].upNodeIndex = newNodeIndex;
-        }
+                    if (c == tokenStart)
+                        continue;
 
-        return *this;
-    }
+                    if (memchr(tokenStart, ',', c - tokenStart))
+                    {
+                        printf("Line %i has a name with a comma in it\n", lineNumber);
+                        return false;
+                    }
 
-    // A vector of ints
-    Solver& AddOption(const std::vector<int>& optionItemIndices)
-    {
-        return AddOption(optionItemIndices.data(), optionItemIndices.size());
-    }
+                    if (!tokens.empty())
+                        tokens += ',';
+                    tokens.append(tokenStart, c);
+                }
 
-    // A list of integers
-    template<size_t N>
-    Solver& AddOption(const int(& optionItemIndices)[N])
-    {
-        return AddOption(optionItemIndices, N);
-    }
+                if (!tokens.empty() && tokens[0] != '|' && !lineLambda(lineNumber, tokens))
+                    return false;
+                line = lineEnd[0] ? &lineEnd[1] : lineEnd;
+            }
+            return true;
+        };
+
+        // The first line is the items. Count the options and their items, to reserve memory for them.
+        std::string itemNames;
+        int firstOptionalItem = -1;
+        size_t optionCount = 0;
+        size_t nodeCount = 0;
+        bool counted = ForEachLine([&](int lineNumber, const std::string& tokens)
+            {
+                if (!itemNames.empty())
+                {
+                    optionCount++;
+                    nodeCount += std::count(tokens.begin(), tokens.end(), ',') + 1;
+                    return true;
+                }
 
-    // Comma seperated list
-    Solver& AddOption(const char* items)
-    {
-        if (m_error || !items || !items[0])
-            return *this;
+                int itemCount = 0;
+                for (size_t start = 0; start < tokens.size(); )
+                {
+                    size_t end = std::min(tokens.find(',', start), tokens.size());
+                    if (end - start == 1 && tokens[start] == '|')
+                    {
+                        if (firstOptionalItem >= 0)
+                        {
+                            printf("Line %i has more than one '|' between items\n", lineNumber);
+                            return false;
+                        }
+                        firstOptionalItem = itemCount;
+                    }
+                    else
+                    {
+                        if (!itemNames.empty())
+                            itemNames += ',';
+                        itemNames.append(tokens, start, end - start);
+                        itemCount++;
+                    }
+                    start = end + 1;
+                }
 
-        m_optionCount++;
+                if (itemNames.empty())
+                {
+                    printf("Line %i doesn't have any items\n", lineNumber);
+                    return false;
+                }
+                return true;
+            }
+        );
 
-        // Add a spacer node
+        Solver ret;
+        if (!counted || itemNames.empty())
         {
-            int newNodeIndex = (int)m_nodes.size();
-            m_nodes.resize(m_nodes.size() + 1);
-            Node& newNode = m_nodes[newNodeIndex];
-            newNode.itemIndex = -1;
+            if (counted)
+                printf("No items given\n");
+            ret.m_error = true;
+            return ret;
         }
 
-        // Add the nodes for this option
-        const char* start = items;
-        while (true)
-        {
-            const char* end = strchr(start, ',');
-            if (!end)
-                end = &start[strlen(start)];
+        ret = AddItems(itemNames.c_str(), firstOptionalItem);
+        ret.Reserve(optionCount, nodeCount);
 
-            bool foundItem = false;
-            for (int itemIndex = 0; itemIndex < m_items.size() - 1; ++itemIndex)
+        bool itemLine = true;
+        ForEachLine([&](int lineNumber, const std::string& tokens)
             {
-                Item& item = m_items[itemIndex];
-                if ((strlen(item.name) == end - start) && (memcmp(item.name, start, end - start) == 0))
+                if (itemLine)
                 {
-                    // Make a new node
-                    foundItem = true;
-                    int newNodeIndex = (int)m_nodes.size();
-                    m_nodes.resize(m_nodes.size() + 1);
-                    Node& newNode = m_nodes[newNodeIndex];
-                    newNode.itemIndex = itemIndex;
-
-                    // hook it into the doubly linked list for the item.  Put it at the end of the list
-                    Node& itemNode = m_nodes[itemIndex];
-                    newNode.upNodeIndex = itemNode.upNodeIndex;
-                    newNode.downNodeIndex = itemIndex;
-                    m_nodes[newNode.upNodeIndex].downNodeIndex = newNodeIndex;
-                    m_nodes[newNode.downNodeIndex].upNodeIndex = newNodeIndex;
+                    itemLine = false;
+                    return !ret.m_error;
                 }
-                if (foundItem)
-                    break;
-            }
 
-            if (!foundItem)
-            {
-                char buffer[8];
-                memcpy(buffer, start, end - start);
-                buffer[end - start] = 0;
-                printf("Could not find item \"%s\" in option\n", buffer);
-                m_error = true;
-                return *this;
+                ret.AddOption(tokens.c_str());
+                if (ret.m_error)
+                    printf("The option on line %i isn't valid\n", lineNumber);
+                return !ret.m_error;
             }
+        );
+        return ret;
+    }
 
-            if (end[0] == 0)
-                break;
-
-            start = &end[1];
+    // Read a file in Knuth's text format. See FromDlxText.
+    static Solver ReadDlxFile(const char* fileName)
+    {
+        std::string text;
+        FILE* file = nullptr;
+        bool ok = fopen_s(&file, fileName, "rb") == 0 && file;
+        if (ok)
+        {
+            // Read it in chunks, since ftell can't give the size of big files everywhere
+            char buffer[64 * 1024];
+            size_t readCount = 0;
+            while ((readCount = fread(buffer, 1, sizeof(buffer), file)) > 0)
+                text.append(buffer, readCount);
+            ok = ferror(file) == 0;
+            fclose(file);
         }
 
-        return *this;
+        if (!ok)
+        {
+            printf("Could not read %s\n", fileName);
+            Solver ret;
+            ret.m_error = true;
+            return ret;
+        }
+        return FromDlxText(text.c_str());
     }
 
-    void Solve()
+    // Save the sealed model: the items, nodes, names, colors and symmetries just as the search uses them, so that
+    // ReadModelFile can load them with one read per array, without parsing or linking anything. Files can only be read
+    // by solvers with the same TIndex. Options can't be selected or excluded while writing.
+    bool WriteModelFile(const char* fileName)
     {
-        auto dummy = [](const auto& solver) {};
-        Solve(dummy);
-    }
+        if (!Seal())
+            return false;
 
-    template <typename TSolutionLambdaFN>
-    void Solve(const TSolutionLambdaFN& solutionLambda)
-    {
-        if (m_error)
+        if (m_level != 0 || !m_excludedOptionIndices.empty())
         {
-            printf("There was an error, not running solver.\n");
-            return;
+            printf("The model can't be written while options are selected or excluded\n");
+            return false;
         }
 
-        if(EXHAUSTIVE)
-            m_rng = GetRNG();
-
-        // Precalculations to help the solver
-        SetOptionPointers();
-        CountItemOptions();
+        FILE* file = nullptr;
+        if (fopen_s(&file, fileName, "wb") != 0 || !file)
+        {
+            printf("Could not open %s for writing\n", fileName);
+            return false;
+        }
+
+        uint32_t header[12] = { c_modelFileMagic, c_modelFileVersion, uint32_t(sizeof(TIndex)), uint32_t(m_items.size()), uint32_t(m_nodes.size()), uint32_t(m_optionCount),
+            uint32_t(m_rootItemIndex), uint32_t(m_firstOptionalItem), m_hasColors ? 1u : 0u, m_hasMultiplicities ? 1u : 0u, uint32_t(m_colorNames.size()), uint32_t(m_symmetryInverses.size()) };
+        bool ok = fwrite(header, sizeof(header), 1, file) == 1 &&
+            WriteArray(file, m_items) && WriteArray(file, m_itemNames) && WriteArray(file, m_nodes) &&
+            WriteArray(file, m_nodeOptionIndices) && WriteArray(file, m_optionNodeIndices) && WriteArray(file, m_nodeColors) &&
+            (!m_hasMultiplicities || WriteArray(file, m_itemBounds));
+
+        for (size_t colorIndex = 0; ok && colorIndex < m_colorNames.size(); ++colorIndex)
+        {
+            uint32_t length = uint32_t(m_colorNames[colorIndex].size());
+            ok = fwrite(&length, sizeof(length), 1, file) == 1 && fwrite(m_colorNames[colorIndex].data(), 1, length, file) == length;
+        }
+
+        for (size_t symmetryIndex = 0; ok && symmetryIndex < m_symmetryInverses.size(); ++symmetryIndex)
+            ok = WriteArray(file, m_symmetryInverses[symmetryIndex]);
+
+        ok = (fclose(file) == 0) && ok;
+        if (!ok)
+            printf("Could not write %s\n", fileName);
+        return ok;
+    }
+
+    // Load a model saved by WriteModelFile, ready to solve
+    static Solver ReadModelFile(const char* fileName)
+    {
+        Solver ret;
+        FILE* file = nullptr;
+        if (fopen_s(&file, fileName, "rb") != 0 || !file)
+        {
+            printf("Could not open %s for reading\n", fileName);
+            ret.m_error = true;
+            return ret;
+        }
+
+        // Every count has to fit the index types, and what it counts has to fit in the rest of the file, before
+        // anything is allocated for it. Symmetries are never the identity, so there aren't any without options.
+        uint32_t header[12] = {};
+        bool ok = fread(header, sizeof(header), 1, file) == 1 && header[0] == c_modelFileMagic && header[1] == c_modelFileVersion &&
+            header[2] == sizeof(TIndex) && header[6] + 1 == header[3] && header[7] <= header[6] &&
+            header[3] <= size_t(std::numeric_limits<TIndex>::max()) && header[4] <= size_t(std::numeric_limits<TIndex>::max()) &&
+            header[5] <= uint32_t(std::numeric_limits<int>::max()) && (header[5] > 0 || header[11] == 0);
+        size_t bytesLeft = ok ? FileBytesLeft(file) : 0;
+        if (ok)
+        {
+            ret.m_rootItemIndex = int(header[6]);
+            ret.m_firstOptionalItem = int(header[7]);
+            ret.m_optionCount = int(header[5]);
+            ret.m_hasColors = header[8] != 0;
+            ret.m_hasMultiplicities = header[9] != 0;
+            ok = ReadArray(file, ret.m_items, header[3], bytesLeft) && ReadArray(file, ret.m_itemNames, header[3], bytesLeft) &&
+                ReadArray(file, ret.m_nodes, header[4], bytesLeft) && ReadArray(file, ret.m_nodeOptionIndices, header[4], bytesLeft) &&
+                ReadArray(file, ret.m_optionNodeIndices, header[5], bytesLeft) && ReadArray(file, ret.m_nodeColors, header[4], bytesLeft) &&
+                (!ret.m_hasMultiplicities || ReadArray(file, ret.m_itemBounds, header[3], bytesLeft)) &&
+                header[10] <= bytesLeft / sizeof(uint32_t) && (header[11] == 0 || header[11] <= bytesLeft / (size_t(header[5]) * sizeof(int)));
+        }
+
+        ret.m_colorNames.resize(ok ? header[10] : 0);
+        for (std::string& colorName : ret.m_colorNames)
+        {
+            uint32_t length = 0;
+            ok = ok && bytesLeft >= sizeof(length) && fread(&length, sizeof(length), 1, file) == 1;
+            bytesLeft -= ok ? sizeof(length) : 0;
+            ok = ok && length <= bytesLeft;
+            bytesLeft -= ok ? length : 0;
+            colorName.resize(ok ? length : 0);
+            ok = ok && fread(colorName.data(), 1, length, file) == length;
+        }
+
+        ret.m_symmetryInverses.resize(ok ? header[11] : 0);
+        for (std::vector<int>& inverse : ret.m_symmetryInverses)
+            ok = ok && ReadArray(file, inverse, header[5], bytesLeft);
+        fclose(file);
+
+        ok = ok && ret.IsValidModel();
+
+        if (!ok)
+        {
+            printf("%s is not a valid model file for this solver\n", fileName);
+            ret = Solver();
+            ret.m_error = true;
+            return ret;
+        }
+
+        ret.FinishSeal();
+        return ret;
+    }
+
+    // Name an item. Names longer than an ItemName holds are an error rather than being cut short, since string
+    // options and printed solutions would mix up items whose names only differ past the cut.
+    Solver& SetItemName(int itemIndex, const char* name)
+    {
+        size_t length = strlen(name);
+        if (itemIndex < 0 || itemIndex >= m_rootItemIndex || length >= sizeof(ItemName::name))
+        {
+            printf("Item %i can't be named \"%s\", max length is %i\n", itemIndex, name, (int)sizeof(ItemName::name) - 1);
+            m_error = true;
+            return *this;
+        }
+
+        memcpy(m_itemNames[itemIndex].name, name, length + 1);
+        m_itemNameIndices.clear();
+        return *this;
+    }
+
+    // Make a primary item need to be covered at least lo and at most hi times, instead of exactly once.
+    // This is Knuth's DLX3. Items with lo = 0 don't need to be covered at all, a bit like secondary items.
+    Solver& SetItemMultiplicity(int itemIndex, int lo, int hi)
+    {
+        if (itemIndex < 0 || itemIndex >= m_firstOptionalItem || lo < 0 || hi < lo || hi < 1 || size_t(hi) >= size_t(std::numeric_limits<TIndex>::max()))
+        {
+            printf("Item %i can't have multiplicity %i:%i, only primary items can have multiplicities, and 0 <= lo <= hi, 1 <= hi\n", itemIndex, lo, hi);
+            m_error = true;
+            return *this;
+        }
+
+        if (hi == 1 && lo == 1 && !m_hasMultiplicities)
+            return *this;
+
+        if (!m_hasMultiplicities)
+            m_itemBounds.resize(m_items.size());
+        m_itemBounds[itemIndex].bound = TIndex(hi);
+        m_itemBounds[itemIndex].slack = TIndex(hi - lo);
+        m_hasMultiplicities = true;
+        return *this;
+    }
+
+    // Tell the search about a symmetry of the model, after all of the options are added. optionPermutation[i] is the
+    // option that option i turns into, and it has to turn solutions into solutions. Solve then only finds the
+    // solutions that are the lex leader of their orbit: the solution with the lowest option indices, compared option
+    // by option, of all of the solutions the symmetries can turn it into. Branches that can only lead to solutions
+    // that aren't lex leaders are cut off as soon as one of the symmetries shows that.
+    // Adding the whole group finds one solution for each orbit. Adding only some of it, like its generators, is still
+    // safe, with at least one solution for each orbit, but fewer are cut off.
+    // Counting with memos and searches with options assumed or excluded don't use the symmetries, since the lex leader
+    // of an orbit might be one that isn't being looked for.
+    Solver& AddSymmetry(std::span<const int> optionPermutation)
+    {
+        bool valid = optionPermutation.size() == size_t(m_optionCount);
+        std::vector<int> inverse(optionPermutation.size(), -1);
+        for (size_t optionIndex = 0; valid && optionIndex < optionPermutation.size(); ++optionIndex)
+        {
+            int image = optionPermutation[optionIndex];
+            valid = image >= 0 && image < m_optionCount && inverse[image] < 0;
+            if (valid)
+                inverse[image] = int(optionIndex);
+        }
+
+        if (!valid)
+        {
+            printf("A symmetry needs to turn each of the %i options into a different option\n", m_optionCount);
+            m_error = true;
+            return *this;
+        }
+
+        // The identity doesn't cut anything off
+        for (size_t optionIndex = 0; optionIndex < inverse.size(); ++optionIndex)
+        {
+            if (inverse[optionIndex] != int(optionIndex))
+            {
+                m_symmetryInverses.push_back(std::move(inverse));
+                break;
+            }
+        }
+        return *this;
+    }
+
+    // integers
+    Solver& AddOption(const int* ints, size_t count)
+    {
+        return AddOption(ints, nullptr, count);
+    }
+
+    // integers, with a color for each item. Color 0 means no color, and only secondary items can have colors.
+    // Options can share a colored secondary item if they give it the same color.
+    Solver& AddOption(const int* ints, const int* colors, size_t count)
+    {
+        if (m_sealed)
+        {
+            printf("Options can't be added after the solver is sealed\n");
+            m_error = true;
+        }
+
+        // The extra node is for the spacer node that SetOptionPointers adds at the end
+        if (m_error || !CheckIndexRange(m_nodes.size() + count + 2))
+            return *this;
+
+        int optionIndex = m_optionCount++;
+        int spacerNodeIndex = (int)m_nodes.size();
+
+        // Add a spacer node
+        {
+            m_nodes.resize(m_nodes.size() + 1 + count);
+            Node<TIndex>& newNode = m_nodes[spacerNodeIndex];
+            newNode.itemIndex = c_spacer;
+        }
+        m_optionNodeIndices.push_back(spacerNodeIndex);
+        m_nodeOptionIndices.resize(m_nodes.size(), optionIndex);
+        m_nodeColors.resize(m_nodes.size(), 0);
+
+        for (int i = 0; i < (int)count; ++i)
+        {
+            int itemIndex = ints[i];
+            if (colors && colors[i] != 0 && !SetNodeColor(spacerNodeIndex + 1 + i, itemIndex, colors[i]))
+                return *this;
+
+            // Make a new node
+            int newNodeIndex = spacerNodeIndex + 1 + i;
+            Node<TIndex>& newNode = m_nodes[newNodeIndex];
+            newNode.itemIndex = TIndex(itemIndex);
+
+            // hook it into the doubly linked list for the item.  Put it at the end of the list
+            Node<TIndex>& itemNode = m_nodes[itemIndex];
+            newNode.upNodeIndex = itemNode.upNodeIndex;
+            newNode.downNodeIndex = TIndex(itemIndex);
+            m_nodes[newNode.upNodeIndex].downNodeIndex = TIndex(newNodeIndex);
+            m_nodes[newNode.downNodeIndex].upNodeIndex = TIndex(newNodeIndex);
+        }
+
+        return *this;
+    }
+
+    // A vector of ints
+    Solver& AddOption(const std::vector<int>& optionItemIndices)
+    {
+        return AddOption(optionItemIndices.data(), optionItemIndices.size());
+    }
+
+    // A list of integers
+    template<size_t N>
+    Solver& AddOption(const int(& optionItemIndices)[N])
+    {
+        return AddOption(optionItemIndices, N);
+    }
+
+    // Comma seperated list.
+    // Secondary items can be given a color after a colon, like "A,B,x:red".
+    // Item names are looked up in a hash map, and the option is added as integers.
+    Solver& AddOption(const char* items)
+    {
+        if (m_error || !items || !items[0])
+            return *this;
+
+        m_parseItemIndices.clear();
+        m_parseColors.clear();
+
+        const char* start = items;
+        while (true)
+        {
+            const char* end = strchr(start, ',');
+            if (!end)
+                end = &start[strlen(start)];
+
+            // Split off the color, if there is one
+            const char* colorStart = (const char*)memchr(start, ':', end - start);
+            const char* nameEnd = colorStart ? colorStart : end;
+
+            int itemIndex = FindItem(start, nameEnd);
+            if (itemIndex < 0)
+            {
+                char buffer[8];
+                size_t length = std::min(size_t(nameEnd - start), _countof(buffer) - 1);
+                memcpy(buffer, start, length);
+                buffer[length] = 0;
+                printf("Could not find item \"%s\" in option\n", buffer);
+                m_error = true;
+                return *this;
+            }
+
+            m_parseItemIndices.push_back(itemIndex);
+            m_parseColors.push_back(colorStart ? GetColor(colorStart + 1, end) : 0);
+
+            if (end[0] == 0)
+                break;
+
+            start = &end[1];
+        }
+
+        return AddOption(m_parseItemIndices.data(), m_parseColors.data(), m_parseItemIndices.size());
+    }
+
+    // Reserve memory for options that are going to be added, so big models don't reallocate while they are built.
+    // nodeCount is the number of items in all of those options added together.
+    Solver& Reserve(size_t optionCount, size_t nodeCount)
+    {
+        // Each option also has a spacer node, and SetOptionPointers adds one more at the end
+        size_t totalNodes = m_nodes.size() + nodeCount + optionCount + 1;
+        m_nodes.reserve(totalNodes);
+        m_nodeOptionIndices.reserve(totalNodes);
+        m_nodeColors.reserve(totalNodes);
+        m_optionNodeIndices.reserve(m_optionNodeIndices.size() + optionCount);
+        return *this;
+    }
+
+    void Solve()
+    {
+        auto dummy = [](const auto&) {};
+        Solve(dummy);
+    }
+
+    template <typename TSolutionLambdaFN>
+    void Solve(const TSolutionLambdaFN& solutionLambda)
+    {
+        Solve(std::span<const int>(), std::span<const int>(), solutionLambda);
+    }
+
+    // Solve with some options assumed to be in the solution, and some options excluded from it.
+    // The model is put back how it was afterwards, so the same solver can be solved again with other lists.
+    // Solutions include the assumed options.
+    template <typename TSolutionLambdaFN>
+    void Solve(std::span<const int> assumeOptions, std::span<const int> excludeOptions, const TSolutionLambdaFN& solutionLambda)
+    {
+        if (!Seal() || !CheckOptionIndices(assumeOptions, "Assumed") || !CheckOptionIndices(excludeOptions, "Excluded"))
+            return;
+
+        if (!EXHAUSTIVE)
+            m_rng = GetFastRNG();
+
+        ResetCounters();
+        m_breakSymmetries = m_breakSymmetries && assumeOptions.empty() && excludeOptions.empty();
 
         // Solve!
         m_start = std::chrono::high_resolution_clock::now();
-        SolveInternal(solutionLambda);
+        bool useBitSolver = assumeOptions.empty() && excludeOptions.empty() && UseBitSolver();
+        if (useBitSolver)
+        {
+            SolveWithBitSolver(solutionLambda);
+        }
+        else
+        {
+            // An assumed option that is excluded, or conflicts with an earlier assumed option, means no solutions
+            ResetSearch();
+            for (int optionIndex : excludeOptions)
+                ExcludeOption(optionIndex);
+
+            bool assumed = true;
+            for (int optionIndex : assumeOptions)
+            {
+                if (!SelectOption(optionIndex))
+                {
+                    printf("Assumed option %i isn't available\n", optionIndex);
+                    assumed = false;
+                    break;
+                }
+            }
+
+            if (assumed && (!m_presolve || Presolve()))
+            {
+                // Checkpoints are only for searches of the whole tree, which a fresh model can find its way back into
+                if (assumeOptions.empty() && excludeOptions.empty() && !m_presolve)
+                    StartCheckpoints();
+
+                m_baseLevel = m_level;
+                m_searchState = SearchState::EnterLevel;
+                SolveInternal(solutionLambda);
+                m_baseLevel = 0;
+                FinishCheckpoints();
+            }
+
+            UndoPresolve();
+            UnselectOptions();
+            UnexcludeOptions();
+        }
 
         // report how long the solve took
         std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
         std::string elapsed = MakeDurationString((float)timeSpan.count());
-        printf("%zu solutions found (%zu options tried, max recursion depth %i) in %s\n\n", m_solutionsFound, m_attempts, m_maxRecursionDepth, elapsed.c_str());
+        std::string presolved = (m_presolveForcedCount > 0) ? ", " + std::to_string(m_presolveForcedCount) + " options forced by presolve" : "";
+        printf("%zu solutions found (%zu options tried, max recursion depth %i%s) in %s%s\n", m_solutionsFound, m_attempts, m_maxRecursionDepth, presolved.c_str(), elapsed.c_str(), useBitSolver ? " using bitsets" : "");
+        m_stats.Print();
+        PrintStopReason();
+        printf("\n");
     }
 
-    std::vector<Item> m_items;
-    std::vector<Node> m_nodes;
-    int m_rootItemIndex = -1;
-    int m_firstOptionalItem = -1;
-    bool m_error = false;
-    std::vector<int> m_solutionOptionNodeIndices;
-    std::mt19937 m_rng;
-    size_t m_solutionsFound = 0;
-    std::chrono::high_resolution_clock::time_point m_start;
-    size_t m_attempts = 0;
-    int m_maxRecursionDepth = 0;
-    int m_optionCount = 0;
+    // Limits that stop a search early. A stop token lets another thread stop it, maxAttempts limits the options tried,
+    // and maxSeconds is a deadline from the start of the search. 0 means no limit.
+    // When a search stops early, m_stopReason says why and m_stopPath says where, and the model is put back how it was.
+    struct SearchLimits
+    {
+        std::stop_token stopToken;
+        size_t maxAttempts = 0;
+        double maxSeconds = 0.0;
+    };
 
-    void PrintSolution() const
+    enum class StopReason
     {
-        printf("Solution #%zu...\n", m_solutionsFound);
+        None,
+        StopRequested,
+        MaxAttempts,
+        Deadline
+    };
 
-        // Show the options in a deterministic order - the same order they were given
-        std::vector<int> solutionOptionNodeIndices = m_solutionOptionNodeIndices;
-        std::sort(solutionOptionNodeIndices.begin(), solutionOptionNodeIndices.end());
+    Solver& SetSearchLimits(const SearchLimits& searchLimits)
+    {
+        m_searchLimits = searchLimits;
+        m_hasSearchLimits = searchLimits.stopToken.stop_possible() || searchLimits.maxAttempts > 0 || searchLimits.maxSeconds > 0.0;
+        return *this;
+    }
 
-        // for each option
-        for (int optionNodeIndex : solutionOptionNodeIndices)
+    // Simplify the model at the start of each Solve, before searching:
+    //  - Take options that are the only option left for a primary item.
+    //  - Take out options that conflict with every option of some primary item, since they can't be in a solution.
+    //    Only items with a few options left are checked, which is where conflicts are likely, and keeps this cheap.
+    //  - Stop without searching if a primary item can't be covered.
+    // This repeats until nothing changes. Taken options are in every solution, and the model is put back afterwards.
+    // The solutions are the same as without presolve. Taking and conflicting options are only done for models without
+    // colors or multiplicities.
+    Solver& SetPresolve(bool presolve)
+    {
+        m_presolve = presolve;
+        return *this;
+    }
+
+    // Have presolve also take out duplicate options, which have the same items (and colors) as an earlier option.
+    // Each set of duplicates only shows up once in the solutions, so a model with duplicate options has fewer solutions
+    // with this on. It only does something with SetPresolve(true), and not for models with multiplicities, where a
+    // duplicate could be taken as well as the original, or symmetries, which might turn the duplicate that is kept
+    // into the one that was taken out.
+    Solver& SetPresolveDuplicates(bool presolveDuplicates)
+    {
+        m_presolveDuplicates = presolveDuplicates;
+        return *this;
+    }
+
+    // Write where Solve is in the search to a file every checkpointSeconds, and when a search limit stops it, and once
+    // more when it finishes. SolveFromCheckpoint carries on from there, with the same model made again, in this
+    // process or another one. Only exhaustive searches of the whole tree with a stateless item heuristic write
+    // checkpoints, so not ones with assumed or excluded options, and not parallel ones. An empty file name turns
+    // checkpoints off.
+    Solver& SetCheckpointFile(const char* fileName, double checkpointSeconds)
+    {
+        m_checkpointFileName = fileName ? fileName : "";
+        m_checkpointSeconds = checkpointSeconds;
+        return *this;
+    }
+
+    // Carry on the search saved in a checkpoint file. The model needs to be the same as the one that wrote it.
+    // Solutions found before the checkpoint aren't found again, but the counts start from the checkpoint's counts,
+    // and the attempt budget of the search limits is for this run. Returns false if the checkpoint can't be used.
+    template <typename TSolutionLambdaFN>
+    bool SolveFromCheckpoint(const char* fileName, const TSolutionLambdaFN& solutionLambda)
+    {
+        static_assert(EXHAUSTIVE, "SolveFromCheckpoint only supports exhaustive searches");
+        static_assert(TItemHeuristic::c_stateless, "SolveFromCheckpoint needs an item heuristic that is stateless");
+
+        if (!Seal())
+            return false;
+
+        SearchCheckpoint checkpoint;
+        if (!checkpoint.ReadFromFile(fileName))
+            return false;
+
+        if (checkpoint.itemCount != uint32_t(m_rootItemIndex) || checkpoint.optionCount != uint32_t(m_optionCount) || checkpoint.nodeCount != uint32_t(m_nodes.size()))
         {
-            // Get to the start of the option list
-            int nodeIndex = optionNodeIndex;
-            while (m_nodes[nodeIndex].itemIndex != -1)
-                nodeIndex--;
+            printf("%s was written for a different model\n", fileName);
+            return false;
+        }
 
-            // for each item in that option
-            nodeIndex++;
-            while (m_nodes[nodeIndex].itemIndex != -1)
+        ResetCounters();
+        m_solutionsFound = checkpoint.solutionsFound;
+        m_attempts = checkpoint.attempts;
+        m_maxRecursionDepth = checkpoint.maxRecursionDepth;
+        m_searchLimitAttemptsStart = m_attempts;
+        m_start = std::chrono::high_resolution_clock::now() - std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(checkpoint.seconds));
+
+        // Resume!
+        if (!checkpoint.finished)
+        {
+            if (!EnterCheckpointPath(checkpoint.optionNumbers))
             {
-                printf("%s ", m_items[m_nodes[nodeIndex].itemIndex].name);
-                nodeIndex++;
+                printf("%s doesn't fit the search tree of this model\n", fileName);
+                return false;
             }
-            printf("\n");
+
+            StartCheckpoints();
+            SolveInternal(solutionLambda);
+            FinishCheckpoints();
         }
 
+        // report how long the solve took, including the time before the checkpoint
         std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
         std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
         std::string elapsed = MakeDurationString((float)timeSpan.count());
-        printf("%s\n\n", elapsed.c_str());
+        printf("%zu solutions found (%zu options tried, max recursion depth %i) in %s, resumed from %s\n", m_solutionsFound, m_attempts, m_maxRecursionDepth, elapsed.c_str(), fileName);
+        m_stats.Print();
+        PrintStopReason();
+        printf("\n");
+        return true;
     }
 
-private:
-    std::string MakeDurationString(float durationInSeconds) const
+    // Start a search that gives solutions one at a time from NextSolution, instead of calling a lambda for each.
+    // The search state is kept between calls, so the caller can stop at any point, or do other work in between.
+    // StopSolutions puts the model back how it was. Returns false if there's an error or an assumed option isn't available.
+    bool StartSolutions(std::span<const int> assumeOptions = {}, std::span<const int> excludeOptions = {})
     {
-        std::string ret;
+        if (!Seal() || !CheckOptionIndices(assumeOptions, "Assumed") || !CheckOptionIndices(excludeOptions, "Excluded"))
+            return false;
 
-        static const float c_oneMinute = 60.0f;
-        static const float c_oneHour = c_oneMinute * 60.0f;
+        if (!EXHAUSTIVE)
+            m_rng = GetFastRNG();
 
-        int hours = int(durationInSeconds / c_oneHour);
-        durationInSeconds -= float(hours) * c_oneHour;
+        ResetCounters();
+        m_start = std::chrono::high_resolution_clock::now();
+        m_breakSymmetries = m_breakSymmetries && assumeOptions.empty() && excludeOptions.empty();
 
-        int minutes = int(durationInSeconds / c_oneMinute);
-        durationInSeconds -= float(minutes) * c_oneMinute;
+        ResetSearch();
+        for (int optionIndex : excludeOptions)
+            ExcludeOption(optionIndex);
 
-        int seconds = int(durationInSeconds);
+        for (int optionIndex : assumeOptions)
+        {
+            // Put back the options that were already excluded and selected
+            if (!SelectOption(optionIndex))
+            {
+                StopSolutions();
+                return false;
+            }
+        }
 
-        durationInSeconds -= float(seconds);
-        int milliseconds = int(durationInSeconds * 1000.0f);
+        m_baseLevel = m_level;
+        m_searchState = SearchState::EnterLevel;
+        m_solutionsStarted = true;
+        return true;
+    }
 
-        char buffer[1024];
-        if (hours < 10)
-            sprintf_s(buffer, "0%i:", hours);
-        else
-            sprintf_s(buffer, "%i:", hours);
-        ret = buffer;
+    // Search until the next solution. Returns false when there are no more.
+    // SolutionOptions() has the solution, and it stays valid until the next call.
+    bool NextSolution()
+    {
+        if (m_searchState == SearchState::Done)
+            return false;
+
+        size_t solutionsFound = m_solutionsFound;
+        m_pauseAtSolutions = true;
+        auto dummy = [](const auto&) {};
+        SolveInternal(dummy);
+        m_pauseAtSolutions = false;
+        return m_solutionsFound != solutionsFound;
+    }
 
-        if (minutes < 10)
-            sprintf_s(buffer, "0%i:", minutes);
-        else
-            sprintf_s(buffer, "%i:", minutes);
-        ret += buffer;
+    // Stop the search from StartSolutions, wherever it is, and put the model back how it was
+    void StopSolutions()
+    {
+        m_solutionsStarted = false;
+        m_searchState = SearchState::Done;
+        m_baseLevel = 0;
+        UnselectOptions();
+        UnexcludeOptions();
+    }
 
-        if (seconds < 10)
+    // A range over the solutions, for range based for loops. Each element is the solver, at a solution.
+    // Leaving the loop early stops the search and puts the model back how it was.
+    //   for (const auto& solver : solver.Solutions())
+    //       solver.PrintSolution();
+    class SolutionRange
+    {
+    public:
+        class Iterator
+        {
+        public:
+            const Solver& operator*() const { return *m_solver; }
+            Iterator& operator++()
+            {
+                if (!m_solver->NextSolution())
+                    m_solver = nullptr;
+                return *this;
+            }
+            bool operator==(std::default_sentinel_t) const { return m_solver == nullptr; }
+
+        private:
+            friend class SolutionRange;
+            Solver* m_solver = nullptr;
+        };
+
+        SolutionRange(Solver& solver, std::span<const int> assumeOptions, std::span<const int> excludeOptions)
+            : m_solver(solver)
+        {
+            m_started = m_solver.StartSolutions(assumeOptions, excludeOptions);
+        }
+
+        ~SolutionRange()
+        {
+            m_solver.StopSolutions();
+        }
+
+        SolutionRange(const SolutionRange&) = delete;
+        SolutionRange& operator=(const SolutionRange&) = delete;
+
+        // Finds the first solution
+        Iterator begin()
+        {
+            Iterator it;
+            it.m_solver = (m_started && m_solver.NextSolution()) ? &m_solver : nullptr;
+            return it;
+        }
+
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+
+    private:
+        Solver& m_solver;
+        bool m_started = false;
+    };
+
+    SolutionRange Solutions(std::span<const int> assumeOptions = {}, std::span<const int> excludeOptions = {})
+    {
+        return SolutionRange(*this, assumeOptions, excludeOptions);
+    }
+
+    // Do the precalculations for solving, once. Options can't be added after this.
+    // Solving seals the solver, but it can also be done up front, like to solve the same model over and over
+    // with different options selected, like a batch of Sudoku puzzles that only differ by their givens.
+    // Each of those solves is SelectOption and ExcludeOption for the options that are different,
+    // SolveSelected, and then UnselectOptions and UnexcludeOptions to put the model back how it was.
+    bool Seal()
+    {
+        if (m_error)
+        {
+            printf("There was an error, not running solver.\n");
+            return false;
+        }
+
+        // A search from StartSolutions that wasn't stopped still has its options taken, so stop it and put the model
+        // back before another search resets the links under it
+        if (m_solutionsStarted)
+        {
+            printf("Stopping the search from StartSolutions, which was still going\n");
+            StopSolutions();
+        }
+
+        if (!m_sealed)
+        {
+            for (const std::vector<int>& inverse : m_symmetryInverses)
+            {
+                if (inverse.size() != size_t(m_optionCount))
+                {
+                    printf("Options were added after a symmetry, not running solver.\n");
+                    m_error = true;
+                    return false;
+                }
+            }
+
+            SetOptionPointers();
+            CountItemOptions();
+            FinishSeal();
+        }
+        return true;
+    }
+
+    // The part of sealing that comes after the items and nodes are all linked up
+    void FinishSeal()
+    {
+        ResetSearch();
+        m_itemHeuristic.Init(m_itemNames);
+        m_optionTaken.assign(m_symmetryInverses.empty() ? 0 : m_optionCount, 0);
+        m_sealed = true;
+    }
+
+    // Take an option out of the model until UnexcludeOptions.
+    // This can also be done after selecting options, like presolve does, since it only unlinks an option that is still
+    // in the lists of uncovered items, the same way the search hides options. It has to be undone before the options
+    // selected before it are. Options that are already out of the model, because they were excluded or an option
+    // that was selected covered one of their items, are left alone.
+    void ExcludeOption(int optionIndex)
+    {
+        if (!IsOptionAvailable(optionIndex))
+            return;
+
+        int firstNodeIndex = m_optionNodeIndices[optionIndex] + 1;
+        for (int nodeIndex = firstNodeIndex; m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+        {
+            const Node<TIndex>& node = m_nodes[nodeIndex];
+            m_nodes[node.upNodeIndex].downNodeIndex = node.downNodeIndex;
+            m_nodes[node.downNodeIndex].upNodeIndex = node.upNodeIndex;
+            m_items[node.itemIndex].optionCount--;
+        }
+        m_excludedOptionIndices.push_back(optionIndex);
+    }
+
+    // Undo all of the ExcludeOption calls, in reverse order
+    void UnexcludeOptions()
+    {
+        while (!m_excludedOptionIndices.empty())
+            UnexcludeLastOption();
+    }
+
+    // Take an option before searching, as if the search had chosen it.
+    // Returns false if the option isn't available anymore because of options that were already selected,
+    // or if it has no primary items.
+    bool SelectOption(int optionIndex)
+    {
+        // The option's nodes must all still be linked in, and their items not covered
+        int optionNodeIndex = -1;
+        for (int nodeIndex = m_optionNodeIndices[optionIndex] + 1; m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+        {
+            int itemIndex = m_nodes[nodeIndex].itemIndex;
+            if (m_items[m_items[itemIndex].leftItemIndex].rightItemIndex != itemIndex || m_nodes[m_nodes[nodeIndex].upNodeIndex].downNodeIndex != nodeIndex)
+                return false;
+
+            if (optionNodeIndex < 0 && itemIndex < m_firstOptionalItem)
+                optionNodeIndex = nodeIndex;
+        }
+
+        if (optionNodeIndex < 0)
+            return false;
+
+        // Choose the option's first primary item, and try this option for it
+        int chosenItemIndex = m_nodes[optionNodeIndex].itemIndex;
+        EnterItem(chosenItemIndex);
+        SearchLevel& searchLevel = m_searchLevels[m_level];
+        searchLevel.optionNodeIndex = optionNodeIndex;
+        searchLevel.optionNumber = 0;
+        searchLevel.branchCount = 1;
+        if (!EXHAUSTIVE)
+        {
+            searchLevel.optionOrderStart = OptionOrderStart();
+            searchLevel.optionOrderCount = 0;
+        }
+        StartOption(chosenItemIndex, optionNodeIndex);
+        m_level++;
+        return true;
+    }
+
+    // Undo all of the SelectOption calls, in reverse order
+    void UnselectOptions()
+    {
+        LeavePath();
+    }
+
+    // Search below the selected options. Solutions include the selected options.
+    // m_solutionsFound and m_attempts are only for this search. The search stops after maxSolutions, if it isn't 0.
+    template <typename TSolutionLambdaFN>
+    void SolveSelected(const TSolutionLambdaFN& solutionLambda, size_t maxSolutions = 0)
+    {
+        ResetCounters();
+        m_breakSymmetries = m_breakSymmetries && m_level == 0 && m_excludedOptionIndices.empty();
+        m_maxSolutions = maxSolutions;
+        m_baseLevel = m_level;
+        m_searchState = SearchState::EnterLevel;
+        SolveInternal(solutionLambda);
+        m_baseLevel = 0;
+        m_maxSolutions = 0;
+    }
+
+    // Count the solutions without visiting each one. The search remembers how many solutions there are below each
+    // state of the remaining items that it gets to, and when it gets to the same state again by a different path,
+    // it uses that count instead of searching again. The solution lambda isn't called.
+    BigCount CountSolutions()
+    {
+        static_assert(EXHAUSTIVE, "CountSolutions only supports exhaustive searches");
+
+        if (!Seal())
+            return BigCount();
+
+        ResetCounters();
+
+        // Count!
+        m_start = std::chrono::high_resolution_clock::now();
+        CountSolutionsInternal();
+        BigCount count = m_levelCounts[0];
+
+        // report how long the count took
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
+        std::string elapsed = MakeDurationString((float)timeSpan.count());
+        printf("%s solutions counted (%zu options tried, %zu states cached, %zu cache hits, max recursion depth %i) in %s\n", count.ToString().c_str(), m_attempts, m_countCache.size(), m_countCacheHits, m_maxRecursionDepth, elapsed.c_str());
+        m_stats.Print();
+        PrintStopReason();
+        printf("\n");
+        return count;
+    }
+
+    // Make a ZDD of all the solutions, like Knuth's DXZ, instead of visiting each one.
+    // This is the same search as CountSolutions, with a ZDD node made for each state instead of only a count.
+    // Option numbers in the ZDD are option indices, the same as SolutionOptions() gives.
+    SolutionZdd MakeSolutionZdd()
+    {
+        static_assert(EXHAUSTIVE, "MakeSolutionZdd only supports exhaustive searches");
+
+        SolutionZdd zdd;
+        if (!Seal())
+            return zdd;
+
+        ResetCounters();
+
+        // Build it!
+        m_start = std::chrono::high_resolution_clock::now();
+        m_zdd = &zdd;
+        CountSolutionsInternal();
+        m_zdd = nullptr;
+        zdd.root = m_levelZddNodes[0];
+
+        // report how long it took
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
+        std::string elapsed = MakeDurationString((float)timeSpan.count());
+        printf("%s solutions in a ZDD of %zu nodes (%zu options tried, %zu states cached, %zu cache hits, max recursion depth %i) in %s\n", m_levelCounts[0].ToString().c_str(), zdd.nodes.size(), m_attempts, m_countCache.size(), m_countCacheHits, m_maxRecursionDepth, elapsed.c_str());
+        m_stats.Print();
+        PrintStopReason();
+        printf("\n");
+        return zdd;
+    }
+
+    // Knuth's estimate of the size of the search tree, from random paths down it.
+    // Each probe takes a random branch at each level, and if there were n1 ways at the first level and n2 at the
+    // second, there are about n1 * n2 nodes at the second level. Averaging over probes gives an unbiased estimate
+    // of the nodes in the tree and of the solutions, which says whether a full solve is worth running.
+    struct TreeSizeEstimate
+    {
+        double attempts = 0.0;
+        double solutions = 0.0;
+    };
+
+    TreeSizeEstimate EstimateTreeSize(int probeCount)
+    {
+        TreeSizeEstimate estimate;
+        if (!Seal() || probeCount <= 0)
+            return estimate;
+
+        // The probes choose items like the search does, which changes the state of a stateful item heuristic, like the
+        // weights of ConflictWeightedHeuristic. Put it back afterwards so the estimate doesn't change the search it's for.
+        TItemHeuristic itemHeuristic = m_itemHeuristic;
+
+        std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        std::mt19937 rng = GetRNG();
+        for (int probeIndex = 0; probeIndex < probeCount; ++probeIndex)
+        {
+            ResetSearch();
+            double levelNodes = 1.0;
+            while (true)
+            {
+                if (m_items[m_rootItemIndex].rightItemIndex >= m_firstOptionalItem)
+                {
+                    estimate.solutions += levelNodes;
+                    break;
+                }
+
+                int chosenItemIndex = ChooseItem();
+                if (chosenItemIndex < 0)
+                    break;
+
+                EnterItem(chosenItemIndex);
+                int branchCount = BranchCount(chosenItemIndex);
+                if (branchCount <= 0)
+                {
+                    LeaveItem(chosenItemIndex);
+                    break;
+                }
+
+                levelNodes *= branchCount;
+                estimate.attempts += levelNodes;
+
+                std::uniform_int_distribution<int> dist(0, branchCount - 1);
+                StartOptionNumber(chosenItemIndex, dist(rng));
+                m_level++;
+            }
+            LeavePath();
+        }
+        m_itemHeuristic = itemHeuristic;
+
+        estimate.attempts /= double(probeCount);
+        estimate.solutions /= double(probeCount);
+
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - start);
+        std::string elapsed = MakeDurationString((float)timeSpan.count());
+        printf("Estimated %.4g options tried and %.4g solutions from %i probes in %s\n\n", estimate.attempts, estimate.solutions, probeCount, elapsed.c_str());
+        return estimate;
+    }
+
+    // How much of the search tree has been searched so far, from 0 to 1.
+    // The option being tried at each level is option i of n, so the options before it at that level, each
+    // with a share of the tree below the level above, are done. This is the same estimate Knuth's programs show.
+    double Progress() const
+    {
+        double progress = 0.0;
+        double share = 1.0;
+        for (int level = 0; level <= m_level && level < (int)m_searchLevels.size(); ++level)
+        {
+            const SearchLevel& searchLevel = m_searchLevels[level];
+            if (searchLevel.branchCount <= 0)
+                break;
+            share /= double(searchLevel.branchCount);
+            progress += share * double(searchLevel.optionNumber);
+        }
+        return progress + share / 2.0;
+    }
+
+    // Solve using multiple threads. The top levels of the search tree are split into tasks, and each worker
+    // solves tasks with its own copy of the items and nodes. Workers that run out of tasks steal from other workers.
+    // The solution lambda is called as solutionLambda(workerSolver, workerId) so that it can keep per worker results
+    // without locking. Solution and attempt counts are summed per task in task order, so they are deterministic.
+    // A threadCount of 0 means to use one thread per hardware thread.
+    template <typename TSolutionLambdaFN>
+    void SolveParallel(int threadCount, const TSolutionLambdaFN& solutionLambda)
+    {
+        static_assert(EXHAUSTIVE, "SolveParallel only supports exhaustive searches");
+        static_assert(TItemHeuristic::c_stateless, "SolveParallel needs an item heuristic that is stateless");
+
+        if (!Seal())
+            return;
+
+        if (threadCount <= 0)
+            threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+
+        ResetCounters();
+
+        m_start = std::chrono::high_resolution_clock::now();
+
+        // Split the search tree deep enough that there are plenty of tasks to go around.
+        // Only the options tried by the last split count as attempts, since the tasks pick up from there.
+        std::vector<std::vector<int>> tasks;
+        for (int splitLevel = 1; splitLevel <= m_firstOptionalItem; ++splitLevel)
+        {
+            m_attempts = 0;
+            m_stats.Reset();
+            CollectTasks(splitLevel, tasks);
+            if (tasks.size() >= size_t(threadCount) * c_tasksPerThread)
+                break;
+        }
+
+        // Deal the tasks out to the workers round robin
+        struct WorkQueue
+        {
+            std::mutex mutex;
+            std::deque<int> taskIndices;
+        };
+        std::vector<WorkQueue> workQueues(threadCount);
+        for (int taskIndex = 0; taskIndex < (int)tasks.size(); ++taskIndex)
+            workQueues[taskIndex % threadCount].taskIndices.push_back(taskIndex);
+
+        // Take work from the front of our own queue, or steal from the back of someone else's
+        auto GetTask = [&](int workerId, int& taskIndex)
+        {
+            for (int offset = 0; offset < threadCount; ++offset)
+            {
+                WorkQueue& workQueue = workQueues[(workerId + offset) % threadCount];
+                std::lock_guard<std::mutex> lock(workQueue.mutex);
+                if (workQueue.taskIndices.empty())
+                    continue;
+
+                if (offset == 0)
+                {
+                    taskIndex = workQueue.taskIndices.front();
+                    workQueue.taskIndices.pop_front();
+                }
+                else
+                {
+                    taskIndex = workQueue.taskIndices.back();
+                    workQueue.taskIndices.pop_back();
+                }
+                return true;
+            }
+            return false;
+        };
+
+        std::vector<size_t> taskSolutionsFound(tasks.size(), 0);
+        std::vector<size_t> taskAttempts(tasks.size(), 0);
+        std::vector<int> workerMaxRecursionDepth(threadCount, 0);
+        std::vector<StopReason> workerStopReasons(threadCount, StopReason::None);
+        std::vector<std::vector<int>> workerStopPaths(threadCount);
+        std::vector<TSearchStats> workerStats(threadCount);
+
+        auto Worker = [&](int workerId)
+        {
+            Solver workerSolver = *this;
+            workerSolver.m_stats.Reset();
+            auto workerLambda = [&](const Solver& solver) { solutionLambda(solver, workerId); };
+
+            int taskIndex = -1;
+            while (GetTask(workerId, taskIndex))
+            {
+                size_t solutionsFound = workerSolver.m_solutionsFound;
+                size_t attempts = workerSolver.m_attempts;
+                workerSolver.SolveTask(tasks[taskIndex], workerLambda);
+                taskSolutionsFound[taskIndex] = workerSolver.m_solutionsFound - solutionsFound;
+                taskAttempts[taskIndex] = workerSolver.m_attempts - attempts;
+            }
+            workerMaxRecursionDepth[workerId] = workerSolver.m_maxRecursionDepth;
+            workerStopReasons[workerId] = workerSolver.m_stopReason;
+            workerStopPaths[workerId] = workerSolver.m_stopPath;
+            workerStats[workerId] = workerSolver.m_stats;
+        };
+
+        std::vector<std::thread> threads;
+        for (int workerId = 1; workerId < threadCount; ++workerId)
+            threads.emplace_back(Worker, workerId);
+        Worker(0);
+        for (std::thread& thread : threads)
+            thread.join();
+
+        // Merge the results
+        for (size_t taskIndex = 0; taskIndex < tasks.size(); ++taskIndex)
+        {
+            m_solutionsFound += taskSolutionsFound[taskIndex];
+            m_attempts += taskAttempts[taskIndex];
+        }
+        for (int depth : workerMaxRecursionDepth)
+            m_maxRecursionDepth = std::max(m_maxRecursionDepth, depth);
+        for (const TSearchStats& stats : workerStats)
+            m_stats.Merge(stats);
+
+        // Each worker checks the limits on its own, with its own attempt count. Report the first one that stopped.
+        for (int workerId = 0; workerId < threadCount && m_stopReason == StopReason::None; ++workerId)
+        {
+            m_stopReason = workerStopReasons[workerId];
+            m_stopPath = workerStopPaths[workerId];
+        }
+
+        // report how long the solve took
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
+        std::string elapsed = MakeDurationString((float)timeSpan.count());
+        printf("%zu solutions found (%zu options tried, max recursion depth %i) in %s using %i threads and %zu tasks\n", m_solutionsFound, m_attempts, m_maxRecursionDepth, elapsed.c_str(), threadCount, tasks.size());
+        m_stats.Print();
+        PrintStopReason();
+        printf("\n");
+    }
+
+    // Search only one shard of the search tree, for running a search across processes or machines.
+    // The tree is split into the paths to every node at splitLevel, and path i is in shard i % shardCount. Every shard
+    // finds the same paths, so shards don't need to talk to each other, and the ShardCounts of all of the shards merge
+    // into the counts of the whole search. Solutions above splitLevel are paths too, so they are found once.
+    template <typename TSolutionLambdaFN>
+    ShardCounts SolveShard(int shardIndex, int shardCount, int splitLevel, const TSolutionLambdaFN& solutionLambda)
+    {
+        static_assert(EXHAUSTIVE, "SolveShard only supports exhaustive searches");
+        static_assert(TItemHeuristic::c_stateless, "SolveShard needs an item heuristic that is stateless");
+
+        ShardCounts shardCounts;
+        if (!Seal())
+            return shardCounts;
+
+        if (shardCount <= 0 || shardIndex < 0 || shardIndex >= shardCount || splitLevel < 0)
+        {
+            printf("Shard %i of %i split at level %i isn't a valid shard\n", shardIndex, shardCount, splitLevel);
+            return shardCounts;
+        }
+
+        ResetCounters();
+
+        m_start = std::chrono::high_resolution_clock::now();
+
+        // The options tried to get to the split level are the same for every shard, so only the first shard counts them
+        std::vector<std::vector<int>> tasks;
+        CollectTasks(splitLevel, tasks);
+        if (shardIndex != 0)
+            m_attempts = 0;
+
+        // Solve!
+        size_t shardTaskCount = 0;
+        for (size_t taskIndex = shardIndex; taskIndex < tasks.size() && m_stopReason == StopReason::None; taskIndex += shardCount)
+        {
+            SolveTask(tasks[taskIndex], solutionLambda);
+            shardTaskCount++;
+        }
+
+        shardCounts.itemCount = uint32_t(m_rootItemIndex);
+        shardCounts.optionCount = uint32_t(m_optionCount);
+        shardCounts.nodeCount = uint32_t(m_nodes.size());
+        shardCounts.splitLevel = uint32_t(splitLevel);
+        shardCounts.shardCount = uint32_t(shardCount);
+        shardCounts.shardIndices.push_back(uint32_t(shardIndex));
+        shardCounts.stopped = m_stopReason != StopReason::None;
+        shardCounts.solutionsFound = m_solutionsFound;
+        shardCounts.attempts = m_attempts;
+        shardCounts.maxRecursionDepth = m_maxRecursionDepth;
+
+        // report how long the solve took
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
+        std::string elapsed = MakeDurationString((float)timeSpan.count());
+        printf("%zu solutions found (%zu options tried, max recursion depth %i) in %s for shard %i of %i (%zu of %zu tasks)\n", m_solutionsFound, m_attempts, m_maxRecursionDepth, elapsed.c_str(), shardIndex, shardCount, shardTaskCount, tasks.size());
+        m_stats.Print();
+        PrintStopReason();
+        printf("\n");
+        return shardCounts;
+    }
+
+    std::vector<Item<TIndex>> m_items;
+    std::vector<Node<TIndex>> m_nodes;
+
+    // Options are numbered in the order they were added.
+    // m_nodeOptionIndices has the option index of each node (-1 for item nodes, and spacer nodes have the option after them).
+    // m_optionNodeIndices has the index of the spacer node before each option.
+    // These are only used to report solutions, so are kept out of the nodes.
+    std::vector<int> m_nodeOptionIndices;
+    std::vector<int> m_optionNodeIndices;
+
+    // The color of each node, which is 0 for no color. This is Knuth's DLX2.
+    // While searching, nodes whose color is already known to be ok are -1, and item nodes have their current color.
+    // Colors named in string options get their names stored in m_colorNames. Color 0 is the empty name.
+    std::vector<int> m_nodeColors;
+    std::vector<std::string> m_colorNames = { "" };
+    bool m_hasColors = false;
+
+    // True if any primary item has a multiplicity other than 1:1, and the bounds of the items if so
+    bool m_hasMultiplicities = false;
+    std::vector<ItemBounds<TIndex>> m_itemBounds;
+
+    // Looking up items by name, for string options
+    std::unordered_map<uint64_t, int> m_itemNameIndices;
+    std::vector<int> m_parseItemIndices;
+    std::vector<int> m_parseColors;
+
+    int m_rootItemIndex = -1;
+    int m_firstOptionalItem = -1;
+    bool m_error = false;
+    std::vector<int> m_solutionOptionIndices;
+    FastRNG m_rng;
+    size_t m_solutionsFound = 0;
+    std::chrono::high_resolution_clock::time_point m_start;
+    size_t m_attempts = 0;
+    int m_maxRecursionDepth = 0;
+    TSearchStats m_stats;
+    TItemHeuristic m_itemHeuristic;
+    int m_optionCount = 0;
+    size_t m_maxSolutions = 0;
+
+    // Sealing does the precalculations for solving, after all options are added
+    bool m_sealed = false;
+    bool m_pauseAtSolutions = false;
+
+    // Why and where the last search stopped early, if it did
+    StopReason m_stopReason = StopReason::None;
+    std::vector<int> m_stopPath;
+    SearchLimits m_searchLimits;
+    bool m_hasSearchLimits = false;
+    static const int c_searchLimitCheckRate = 1024;
+    int m_searchLimitCheckCountdown = c_searchLimitCheckRate;
+    std::chrono::high_resolution_clock::time_point m_deadline;
+    size_t m_searchLimitAttemptsStart = 0;
+    std::vector<int> m_excludedOptionIndices;
+
+    // What presolve did, so it can be undone
+    struct PresolveStep
+    {
+        bool selected = false;
+        int optionIndex = -1;
+    };
+    bool m_presolve = false;
+    bool m_presolveDuplicates = false;
+    static const int c_presolveMaxItemOptions = 8;
+
+    // The options presolve took are levels below the search, which aren't counted in its depth
+    int m_presolveForcedCount = 0;
+    std::vector<PresolveStep> m_presolveSteps;
+    std::vector<int> m_presolveItemMarks;
+    int m_presolveMark = 0;
+
+    // Symmetries of the model, as the inverse of each option permutation, and which options the search has taken.
+    // m_breakSymmetries is off for searches that only look at some of the solutions.
+    std::vector<std::vector<int>> m_symmetryInverses;
+    std::vector<uint8_t> m_optionTaken;
+    bool m_breakSymmetries = false;
+
+    // For each level and symmetry, the first option IsSymmetryLeader hadn't shown to be equal to its image, or
+    // m_optionCount if the symmetry was decided in our favor. A level's positions are only valid if the search got
+    // to it through EnterLevel, so levels entered by a path start over.
+    std::vector<int> m_levelSymmetryPositions;
+    std::vector<uint8_t> m_levelSymmetryPositionsValid;
+
+    // Checkpoints of where the search is. They are checked for at the same rate as search limits.
+    std::string m_checkpointFileName;
+    double m_checkpointSeconds = 0.0;
+    bool m_writeCheckpoints = false;
+    int m_checkpointCountdown = c_searchLimitCheckRate;
+    std::chrono::high_resolution_clock::time_point m_nextCheckpoint;
+
+    // The explicit search stack, which is one of these for each level, and where the search loop is in it.
+    // m_searchState is only where the loop left off. The loop itself keeps its place in locals while it runs.
+    struct SearchLevel
+    {
+        int itemIndex = -1;         // The item chosen at this level
+        int optionNodeIndex = -1;   // The option being tried for it, or the item itself when leaving it alone
+        int optionNumber = 0;       // How many options were tried for it before this one
+        int branchCount = 0;        // How many ways this level branches, or 0 if it hasn't chosen an item yet
+        int tweakStart = 0;         // Where this level's options start in m_tweakedNodeIndices
+        int optionOrderStart = 0;   // Where this level's options start in m_optionOrders, for non exhaustive searches
+        int optionOrderCount = 0;
+    };
+    enum class SearchState
+    {
+        EnterLevel,
+        TryOption,
+        LeaveLevel,
+        Done
+    };
+    SearchState m_searchState = SearchState::Done;
+    bool m_solutionsStarted = false;
+    int m_level = 0;
+    std::vector<SearchLevel> m_searchLevels;
+    // For non exhaustive searches, the option nodes of each level in the order they are tried, one level after another
+    std::vector<int> m_optionOrders;
+    std::vector<int> m_tweakedNodeIndices;
+
+    // Searches can be limited to the part of the tree below m_baseLevel, and can be stopped at m_splitLevel
+    // to record the paths there as tasks, instead of going deeper.
+    static const int c_tasksPerThread = 16;
+    int m_baseLevel = 0;
+    int m_splitLevel = -1;
+    std::vector<std::vector<int>>* m_splitTasks = nullptr;
+
+    // When counting solutions, m_levelCounts[level] adds up the solutions below the state the search entered that
+    // level with. States are keyed by the remaining items, and the colors and bounds of those items.
+    struct CountCacheKeyHash
+    {
+        size_t operator()(const std::vector<uint32_t>& key) const
+        {
+            uint64_t hash = 14695981039346656037ull;
+            for (uint32_t word : key)
+            {
+                hash ^= word;
+                hash *= 1099511628211ull;
+            }
+            return size_t(hash);
+        }
+    };
+    struct CountCacheEntry
+    {
+        BigCount count;
+        uint32_t zddNode = 0;
+    };
+    bool m_countSolutions = false;
+    std::vector<BigCount> m_levelCounts;
+    std::vector<std::vector<uint32_t>> m_levelCountKeys;
+    std::vector<char> m_levelCountKeyed;
+    std::unordered_map<std::vector<uint32_t>, CountCacheEntry, CountCacheKeyHash> m_countCache;
+    size_t m_countCacheHits = 0;
+
+    // When making a ZDD, m_levelZddNodes[level] is the ZDD node for the state the search entered that level with.
+    // It's made when leaving the level, from the option tried and the ZDD node below for each branch that had solutions.
+    SolutionZdd* m_zdd = nullptr;
+    std::vector<uint32_t> m_levelZddNodes;
+    std::vector<std::vector<std::pair<int, uint32_t>>> m_levelZddBranches;
+
+    // The option indices of the current solution, in the order they were chosen
+    std::span<const int> SolutionOptions() const
+    {
+        return m_solutionOptionIndices;
+    }
+
+    // The name of each item. These are set with SetItemName.
+    std::span<const ItemName> ItemNames() const
+    {
+        return m_itemNames;
+    }
+
+    void PrintSolution() const
+    {
+        printf("Solution #%zu...\n", m_solutionsFound);
+
+        // Show the options in a deterministic order - the same order they were given
+        std::vector<int> solutionOptionIndices(m_solutionOptionIndices);
+        std::sort(solutionOptionIndices.begin(), solutionOptionIndices.end());
+
+        // for each option
+        for (int optionIndex : solutionOptionIndices)
+        {
+            PrintOptionItems(optionIndex);
+            printf("\n");
+        }
+
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
+        std::string elapsed = MakeDurationString((float)timeSpan.count());
+        printf("%s\n\n", elapsed.c_str());
+    }
+
+private:
+    // Only SetItemName changes these, so that it can check the names and keep m_itemNameIndices up to date
+    std::vector<ItemName> m_itemNames;
+
+    static const uint32_t c_modelFileMagic = 0x4D584C44; // "DLXM"
+    static const uint32_t c_modelFileVersion = 2;
+
+    template <typename T>
+    static bool WriteArray(FILE* file, const std::vector<T>& values)
+    {
+        return fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+    }
+
+    // Only allocates for counts that fit in the bytes left to read, which goes down by what was read
+    template <typename T>
+    static bool ReadArray(FILE* file, std::vector<T>& values, size_t count, size_t& bytesLeft)
+    {
+        if (count > bytesLeft / sizeof(T))
+            return false;
+
+        bytesLeft -= count * sizeof(T);
+        values.resize(count);
+        return fread(values.data(), sizeof(T), count, file) == count;
+    }
+
+    // Make sure a model read from a file is one that WriteModelFile could have written, so nothing else needs to check.
+    // Every index has to be in range, and every link has to be linked back to, so that each list is a loop that ends.
+    bool IsValidModel() const
+    {
+        int itemCount = int(m_items.size());
+        int nodeCount = int(m_nodes.size());
+        auto InRange = [](int index, int count) { return index >= 0 && index < count; };
+        if (nodeCount <= m_rootItemIndex || m_nodes[m_rootItemIndex].itemIndex != c_spacer || m_nodes.back().itemIndex != c_spacer)
+            return false;
+
+        for (int itemIndex = 0; itemIndex < itemCount; ++itemIndex)
+        {
+            const Item<TIndex>& item = m_items[itemIndex];
+            if (!InRange(item.leftItemIndex, itemCount) || !InRange(item.rightItemIndex, itemCount) ||
+                m_items[item.leftItemIndex].rightItemIndex != itemIndex || m_items[item.rightItemIndex].leftItemIndex != itemIndex ||
+                memchr(m_itemNames[itemIndex].name, 0, sizeof(ItemName::name)) == nullptr)
+                return false;
+
+            // The bounds SetItemMultiplicity allows for primary items, and the exactly once of everything else
+            const ItemBounds<TIndex>* bounds = m_hasMultiplicities ? &m_itemBounds[itemIndex] : nullptr;
+            if (bounds && (itemIndex < m_firstOptionalItem ?
+                    (int(bounds->bound) < 1 || size_t(bounds->bound) >= size_t(std::numeric_limits<TIndex>::max()) || int(bounds->slack) < 0 || int(bounds->slack) > int(bounds->bound)) :
+                    (int(bounds->bound) != 1 || int(bounds->slack) != 0)))
+                return false;
+        }
+
+        // Item header nodes are their own item, spacer nodes link to the spacers before and after them, and the
+        // nodes of options link to the other nodes of the same item
+        std::vector<int> optionCounts(itemCount, 0);
+        for (int nodeIndex = 0; nodeIndex < nodeCount; ++nodeIndex)
+        {
+            const Node<TIndex>& node = m_nodes[nodeIndex];
+            if (!InRange(node.upNodeIndex, nodeCount) || !InRange(node.downNodeIndex, nodeCount) ||
+                m_nodes[node.upNodeIndex].downNodeIndex != nodeIndex || m_nodes[node.downNodeIndex].upNodeIndex != nodeIndex ||
+                m_nodes[node.downNodeIndex].itemIndex != node.itemIndex)
+                return false;
+
+            if (node.itemIndex == c_spacer)
+                continue;
+
+            bool isHeader = nodeIndex < m_rootItemIndex;
+            if (isHeader ? (node.itemIndex != nodeIndex) : (!InRange(node.itemIndex, m_rootItemIndex) || !InRange(m_nodeOptionIndices[nodeIndex], m_optionCount)))
+                return false;
+
+            if (!isHeader)
+                optionCounts[node.itemIndex]++;
+        }
+
+        for (int itemIndex = 0; itemIndex < m_rootItemIndex; ++itemIndex)
+        {
+            if (int(m_items[itemIndex].optionCount) != optionCounts[itemIndex])
+                return false;
+        }
+
+        // Each option starts at a spacer, and its nodes know which option they are in
+        for (int optionIndex = 0; optionIndex < m_optionCount; ++optionIndex)
+        {
+            int spacerNodeIndex = m_optionNodeIndices[optionIndex];
+            if (!InRange(spacerNodeIndex, nodeCount - 1) || m_nodes[spacerNodeIndex].itemIndex != c_spacer)
+                return false;
+
+            for (int nodeIndex = spacerNodeIndex + 1; m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+            {
+                if (m_nodeOptionIndices[nodeIndex] != optionIndex)
+                    return false;
+            }
+        }
+
+        // Each symmetry has to be a permutation of the options
+        std::vector<uint8_t> seen;
+        for (const std::vector<int>& inverse : m_symmetryInverses)
+        {
+            seen.assign(m_optionCount, 0);
+            for (int optionIndex : inverse)
+            {
+                if (!InRange(optionIndex, m_optionCount) || seen[optionIndex])
+                    return false;
+                seen[optionIndex] = 1;
+            }
+        }
+        return true;
+    }
+
+    // Print the names of the items in an option
+    void PrintOptionItems(int optionIndex) const
+    {
+        for (int nodeIndex = m_optionNodeIndices[optionIndex] + 1; nodeIndex < (int)m_nodes.size() && m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+        {
+            int itemIndex = m_nodes[nodeIndex].itemIndex;
+            int color = (m_nodeColors[nodeIndex] < 0) ? m_nodeColors[itemIndex] : m_nodeColors[nodeIndex];
+            if (color == 0)
+                printf("%s ", m_itemNames[itemIndex].name);
+            else if (color < (int)m_colorNames.size())
+                printf("%s:%s ", m_itemNames[itemIndex].name, m_colorNames[color].c_str());
+            else
+                printf("%s:%i ", m_itemNames[itemIndex].name, color);
+        }
+    }
+
+    // Get the color number for a color name, adding it if it's new
+    int GetColor(const char* start, const char* end)
+    {
+        for (int color = 1; color < (int)m_colorNames.size(); ++color)
+        {
+            if (m_colorNames[color].size() == size_t(end - start) && memcmp(m_colorNames[color].data(), start, end - start) == 0)
+                return color;
+        }
+
+        m_colorNames.emplace_back(start, end);
+        return (int)m_colorNames.size() - 1;
+    }
+
+    // Item names are at most 7 characters, so they are packed into a uint64_t to use as a hash map key
+    static uint64_t ItemNameKey(const char* start, const char* end)
+    {
+        uint64_t key = 0;
+        memcpy(&key, start, end - start);
+        return key;
+    }
+
+    // Get the index of the item with this name, or -1 if there isn't one.
+    // The map is made the first time it's needed, so items need to be named before string options are added.
+    int FindItem(const char* start, const char* end)
+    {
+        if (size_t(end - start) >= sizeof(ItemName::name))
+            return -1;
+
+        if (m_itemNameIndices.empty())
+        {
+            m_itemNameIndices.reserve(m_rootItemIndex);
+            for (int itemIndex = 0; itemIndex < m_rootItemIndex; ++itemIndex)
+            {
+                const char* name = m_itemNames[itemIndex].name;
+                m_itemNameIndices.emplace(ItemNameKey(name, name + strlen(name)), itemIndex);
+            }
+        }
+
+        auto it = m_itemNameIndices.find(ItemNameKey(start, end));
+        return (it != m_itemNameIndices.end()) ? it->second : -1;
+    }
+
+    bool SetNodeColor(int nodeIndex, int itemIndex, int color)
+    {
+        if (itemIndex < m_firstOptionalItem || color <= 0)
+        {
+            printf("Item \"%s\" can't have color %i, only secondary items can have colors, and colors must be positive\n", m_itemNames[itemIndex].name, color);
+            m_error = true;
+            return false;
+        }
+
+        m_nodeColors[nodeIndex] = color;
+        m_hasColors = true;
+        return true;
+    }
+
+    // Items and nodes are referred to by TIndex, and the largest TIndex value is reserved for spacer nodes.
+    // Report an error if an array would grow too large for that.
+    bool CheckIndexRange(size_t size)
+    {
+        if (size <= size_t(std::numeric_limits<TIndex>::max()))
+            return true;
+
+        if (!m_error)
+            printf("Too many items or nodes for the index type, the max is %zu\n", size_t(std::numeric_limits<TIndex>::max()));
+        m_error = true;
+        return false;
+    }
+
+    // Assumed and excluded options come from the caller, so make sure they are options of this model
+    bool CheckOptionIndices(std::span<const int> optionIndices, const char* what) const
+    {
+        for (int optionIndex : optionIndices)
+        {
+            if (optionIndex < 0 || optionIndex >= m_optionCount)
+            {
+                printf("%s option %i isn't an option of this model, which has %i options\n", what, optionIndex, m_optionCount);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string MakeDurationString(float durationInSeconds) const
+    {
+        std::string ret;
+
+        static const float c_oneMinute = 60.0f;
+        static const float c_oneHour = c_oneMinute * 60.0f;
+
+        int hours = int(durationInSeconds / c_oneHour);
+        durationInSeconds -= float(hours) * c_oneHour;
+
+        int minutes = int(durationInSeconds / c_oneMinute);
+        durationInSeconds -= float(minutes) * c_oneMinute;
+
+        int seconds = int(durationInSeconds);
+
+        durationInSeconds -= float(seconds);
+        int milliseconds = int(durationInSeconds * 1000.0f);
+
+        char buffer[1024];
+        if (hours < 10)
+            sprintf_s(buffer, "0%i:", hours);
+        else
+            sprintf_s(buffer, "%i:", hours);
+        ret = buffer;
+
+        if (minutes < 10)
+            sprintf_s(buffer, "0%i:", minutes);
+        else
+            sprintf_s(buffer, "%i:", minutes);
+        ret += buffer;
+
+        if (seconds < 10)
             sprintf_s(buffer, "0%i", seconds);
         else
-            sprintf_s(buffer, "%i", seconds);
-        ret += buffer;
+            sprintf_s(buffer, "%i", seconds);
+        ret += buffer;
+
+        if (milliseconds < 10)
+            sprintf_s(buffer, ".00%i", milliseconds);
+        else if (milliseconds < 100)
+            sprintf_s(buffer, ".0%i", milliseconds);
+        else
+            sprintf_s(buffer, ".%i", milliseconds);
+        ret += buffer;
+
+        return ret;
+    }
+
+    // Covering and uncovering are most of the search time. They are called from a few places, which keeps the compiler
+    // from inlining them on its own, and the calls cost more than the extra code.
+    // COLORS is false for searches that know the model has no colors, which go straight to the loop without color checks.
+    template <bool COLORS = true>
+    __forceinline void CoverItem(int itemIndex)
+    {
+        // Remove this item from the item list
+        m_items[m_items[itemIndex].leftItemIndex].rightItemIndex = m_items[itemIndex].rightItemIndex;
+        m_items[m_items[itemIndex].rightItemIndex].leftItemIndex = m_items[itemIndex].leftItemIndex;
+        m_stats.LinkUpdates(2);
+
+        if (SHOW_ALL_ATTEMPTS)
+        {
+            for (int i = 0; i <= m_level; ++i)
+                printf("  ");
+            printf("Covering %s\n", m_itemNames[itemIndex].name);
+        }
+
+        // Remove all options of this item from the lists of the other items
+        for (int optionNodeIndex = m_nodes[itemIndex].downNodeIndex; optionNodeIndex != itemIndex; optionNodeIndex = m_nodes[optionNodeIndex].downNodeIndex)
+        {
+            if (COLORS)
+                HideOption(optionNodeIndex);
+            else
+                HideOptionNodes<false>(optionNodeIndex);
+        }
+    }
+
+    template <bool COLORS = true>
+    __forceinline void UncoverItem(int itemIndex)
+    {
+        // Add all options of this item back to the lists of the other items.
+        // This is done in the reverse order of CoverItem, so that every link is restored to exactly what it was.
+        for (int optionNodeIndex = m_nodes[itemIndex].upNodeIndex; optionNodeIndex != itemIndex; optionNodeIndex = m_nodes[optionNodeIndex].upNodeIndex)
+        {
+            if (COLORS)
+                UnhideOption(optionNodeIndex);
+            else
+                UnhideOptionNodes<false>(optionNodeIndex);
+        }
+
+        // Add this item back to the list
+        m_items[m_items[itemIndex].leftItemIndex].rightItemIndex = TIndex(itemIndex);
+        m_items[m_items[itemIndex].rightItemIndex].leftItemIndex = TIndex(itemIndex);
+        m_stats.LinkUpdates(2);
+    }
+
+    // Remove the option that this node is part of from the lists of all of the other items in it.
+    void HideOption(int optionNodeIndex)
+    {
+        if (SHOW_ALL_ATTEMPTS)
+        {
+            for (int i = 0; i <= m_level + 1; ++i)
+                printf("  ");
+            printf("Removing ");
+            PrintOptionItems(m_nodeOptionIndices[optionNodeIndex]);
+            printf("\n");
+        }
+
+        // This is the innermost loop of the search. Models without colors get a loop without the color check in it.
+        if (m_hasColors)
+            HideOptionNodes<true>(optionNodeIndex);
+        else
+            HideOptionNodes<false>(optionNodeIndex);
+    }
+
+    // Nodes of purified items that have the right color are left alone, which is what marking their color as -1 is for.
+    template <bool COLORS>
+    void HideOptionNodes(int optionNodeIndex)
+    {
+        int nodeIndex = optionNodeIndex + 1;
+        while (nodeIndex != optionNodeIndex)
+        {
+            // if we reached the end of the list, wrap around
+            if (m_nodes[nodeIndex].itemIndex == c_spacer)
+            {
+                nodeIndex = m_nodes[nodeIndex].upNodeIndex + 1;
+                continue;
+            }
+
+            if (COLORS && m_nodeColors[nodeIndex] < 0)
+            {
+                nodeIndex++;
+                continue;
+            }
+
+            // Remove the option from this item's list
+            m_nodes[m_nodes[nodeIndex].upNodeIndex].downNodeIndex = m_nodes[nodeIndex].downNodeIndex;
+            m_nodes[m_nodes[nodeIndex].downNodeIndex].upNodeIndex = m_nodes[nodeIndex].upNodeIndex;
+            m_stats.LinkUpdates(2);
+
+            // Remember that an option has been removed
+            m_items[m_nodes[nodeIndex].itemIndex].optionCount--;
+
+            if (SHOW_ALL_ATTEMPTS && m_items[m_nodes[nodeIndex].itemIndex].optionCount == 0)
+            {
+                for (int i = 0; i <= m_level; ++i)
+                    printf("  ");
+                printf("Covering %s resulted in %s having no valid options\n", m_itemNames[m_nodes[optionNodeIndex].itemIndex].name, m_itemNames[m_nodes[nodeIndex].itemIndex].name);
+            }
+
+            // go to the next node in the option
+            nodeIndex++;
+        }
+    }
+
+    // Undo HideOption, going through the nodes in reverse order
+    void UnhideOption(int optionNodeIndex)
+    {
+        if (m_hasColors)
+            UnhideOptionNodes<true>(optionNodeIndex);
+        else
+            UnhideOptionNodes<false>(optionNodeIndex);
+    }
+
+    template <bool COLORS>
+    void UnhideOptionNodes(int optionNodeIndex)
+    {
+        int nodeIndex = optionNodeIndex - 1;
+        while (nodeIndex != optionNodeIndex)
+        {
+            // if we reached the start of the list, wrap around to the end again
+            if (m_nodes[nodeIndex].itemIndex == c_spacer)
+            {
+                nodeIndex = m_nodes[nodeIndex].downNodeIndex - 1;
+                continue;
+            }
+
+            if (COLORS && m_nodeColors[nodeIndex] < 0)
+            {
+                nodeIndex--;
+                continue;
+            }
+
+            // Add the option back into this item's list
+            m_nodes[m_nodes[nodeIndex].upNodeIndex].downNodeIndex = TIndex(nodeIndex);
+            m_nodes[m_nodes[nodeIndex].downNodeIndex].upNodeIndex = TIndex(nodeIndex);
+            m_stats.LinkUpdates(2);
+
+            // Remember that an option has been restored
+            m_items[m_nodes[nodeIndex].itemIndex].optionCount++;
+
+            // go to the previous node in the option
+            nodeIndex--;
+        }
+    }
+
+    // A colored secondary item was chosen with the color of this node.
+    // Options that give the item a different color are hidden, and the other nodes with the same color are marked as
+    // already ok, so choosing those options later doesn't purify again.
+    void PurifyItem(int colorNodeIndex)
+    {
+        int color = m_nodeColors[colorNodeIndex];
+        int itemIndex = m_nodes[colorNodeIndex].itemIndex;
+        m_nodeColors[itemIndex] = color;
+
+        if (SHOW_ALL_ATTEMPTS)
+        {
+            for (int i = 0; i <= m_level; ++i)
+                printf("  ");
+            printf("Purifying %s:%s\n", m_itemNames[itemIndex].name, m_colorNames[color].c_str());
+        }
+
+        for (int nodeIndex = m_nodes[itemIndex].downNodeIndex; nodeIndex != itemIndex; nodeIndex = m_nodes[nodeIndex].downNodeIndex)
+        {
+            if (m_nodeColors[nodeIndex] != color)
+                HideOption(nodeIndex);
+            else if (nodeIndex != colorNodeIndex)
+                m_nodeColors[nodeIndex] = -1;
+        }
+    }
+
+    // Undo PurifyItem, in reverse order
+    void UnpurifyItem(int colorNodeIndex)
+    {
+        int color = m_nodeColors[colorNodeIndex];
+        int itemIndex = m_nodes[colorNodeIndex].itemIndex;
+
+        for (int nodeIndex = m_nodes[itemIndex].upNodeIndex; nodeIndex != itemIndex; nodeIndex = m_nodes[nodeIndex].upNodeIndex)
+        {
+            if (m_nodeColors[nodeIndex] < 0)
+                m_nodeColors[nodeIndex] = color;
+            else if (nodeIndex != colorNodeIndex)
+                UnhideOption(nodeIndex);
+        }
+
+        m_nodeColors[itemIndex] = 0;
+    }
+
+    void PrintProgress()
+    {
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
+        std::string elapsed = MakeDurationString((float)timeSpan.count());
+
+        // The time left is the time so far, scaled by how much is left compared to how much is done
+        double progress = Progress();
+        std::string remaining = MakeDurationString(float(timeSpan.count() * (1.0 - progress) / progress));
+        printf("[%s] %zu solutions, %zu options tried, %.3f%% done, about %s left\n", elapsed.c_str(), m_solutionsFound, m_attempts, progress * 100.0, remaining.c_str());
+    }
+
+    // How many ways there are to branch on an item.
+    // For items with multiplicities this is Knuth's DLX3 heuristic, which counts leaving the item alone as a way when
+    // it already has enough options, and takes away the options it still needs.
+    template <bool MULTIPLICITIES = true>
+    int ItemScore(int itemIndex) const
+    {
+        if (!MULTIPLICITIES || !m_hasMultiplicities)
+            return m_items[itemIndex].optionCount;
+
+        const ItemBounds<TIndex>& bounds = m_itemBounds[itemIndex];
+        int slack = std::min<int>(bounds.slack, bounds.bound);
+        return int(m_items[itemIndex].optionCount) + slack - int(bounds.bound) + 1;
+    }
+
+    // Returns the item that the item heuristic chooses, or -1 if some item can't be satisfied anymore.
+    // Any method for choosing from the remaining items will handle all solutions
+    // but choosing the item with the lowest score can make for a smaller search tree.
+    template <bool MULTIPLICITIES = true>
+    int ChooseItem()
+    {
+        m_itemHeuristic.StartChoosing();
+
+        int itemIndex = m_items[m_rootItemIndex].rightItemIndex;
+        int chosenItemIndex = itemIndex;
+        int chosenItemScore = ItemScore<MULTIPLICITIES>(itemIndex);
+        int lowestItemIndex = itemIndex;
+        int lowestItemScore = chosenItemScore;
+
+        itemIndex = m_items[itemIndex].rightItemIndex;
+        while (itemIndex < m_firstOptionalItem)
+        {
+            int itemScore = ItemScore<MULTIPLICITIES>(itemIndex);
+
+            // Without multiplicities no score is below 0, so the first item without options is the one we'd backtrack on.
+            // A stateless heuristic doesn't need to see the rest of the items, so stop looking.
+            if (!MULTIPLICITIES && TItemHeuristic::c_stateless && itemScore <= 0)
+            {
+                lowestItemScore = itemScore;
+                lowestItemIndex = itemIndex;
+                break;
+            }
+
+            if (m_itemHeuristic.Prefer(itemIndex, itemScore, chosenItemIndex, chosenItemScore))
+            {
+                chosenItemScore = itemScore;
+                chosenItemIndex = itemIndex;
+            }
+
+            if (itemScore < lowestItemScore)
+            {
+                lowestItemScore = itemScore;
+                lowestItemIndex = itemIndex;
+            }
+
+            itemIndex = m_items[itemIndex].rightItemIndex;
+        }
+
+        // If we found an item without any valid options, we need to backtrack.
+        if (lowestItemScore <= 0)
+        {
+            m_itemHeuristic.Conflict(lowestItemIndex);
+            return -1;
+        }
+        return chosenItemIndex;
+    }
+
+    // Start branching on an item at the current level (Knuth's M4).
+    // Every option taken for an item uses up one of its bound, and once the bound is used up the item is covered.
+    void EnterItem(int chosenItemIndex)
+    {
+        SearchLevel& searchLevel = m_searchLevels[m_level];
+        searchLevel.itemIndex = chosenItemIndex;
+        searchLevel.tweakStart = (int)m_tweakedNodeIndices.size();
+        if (UseBound(chosenItemIndex))
+            CoverItem(chosenItemIndex);
+        searchLevel.branchCount = BranchCount(chosenItemIndex);
+    }
+
+    // How many ways the search will branch on the item just entered at this level.
+    // Exact items try each of their options. Other items tweak out each option they try, and stop when there
+    // aren't enough left to reach the lower bound, with leaving the item alone as the last way.
+    int BranchCount(int chosenItemIndex) const
+    {
+        int optionCount = m_items[chosenItemIndex].optionCount;
+        if (IsExactItem(chosenItemIndex))
+            return optionCount;
+
+        const ItemBounds<TIndex>& bounds = m_itemBounds[chosenItemIndex];
+        int branchCount = optionCount - (int(bounds.bound) - int(bounds.slack));
+        return std::clamp(branchCount, 0, optionCount + 1);
+    }
+
+    // Undo EnterItem, putting back the options that were tweaked out of the item's list at this level (Knuth's M8)
+    void LeaveItem(int chosenItemIndex)
+    {
+        while ((int)m_tweakedNodeIndices.size() > m_searchLevels[m_level].tweakStart)
+        {
+            UntweakOption(m_tweakedNodeIndices.back(), chosenItemIndex);
+            m_tweakedNodeIndices.pop_back();
+        }
+
+        if (ReleaseBound(chosenItemIndex))
+            UncoverItem(chosenItemIndex);
+    }
+
+    // Use up one of a primary item's bound. Returns true if that was the last of it, so the item needs covering.
+    bool UseBound(int itemIndex)
+    {
+        return !m_hasMultiplicities || --m_itemBounds[itemIndex].bound == 0;
+    }
+
+    // Undo UseBound. Returns true if the item was used up, so it needs uncovering.
+    bool ReleaseBound(int itemIndex)
+    {
+        return !m_hasMultiplicities || m_itemBounds[itemIndex].bound++ == 0;
+    }
+
+    // True if this level's item takes exactly one option, like in a plain exact cover problem
+    bool IsExactItem(int itemIndex) const
+    {
+        return !m_hasMultiplicities || (m_itemBounds[itemIndex].bound == 0 && m_itemBounds[itemIndex].slack == 0);
+    }
+
+    // Returns false if there is nothing left to try for the item at this level.
+    // optionNodeIndex being the item itself means to leave the item with the options it already has.
+    bool CanTryOption(int chosenItemIndex, int optionNodeIndex) const
+    {
+        if (IsExactItem(chosenItemIndex))
+            return optionNodeIndex != chosenItemIndex;
+
+        // Stop if there aren't enough options left to reach the item's lower bound
+        const ItemBounds<TIndex>& bounds = m_itemBounds[chosenItemIndex];
+        return int(m_items[chosenItemIndex].optionCount) > int(bounds.bound) - int(bounds.slack);
+    }
+
+    // Take an option for the item at this level (Knuth's M5 and M6).
+    // For items with multiplicities, the option is tweaked out of the item's list first, so that deeper levels
+    // choosing the item again only see the options after this one. That way each combination is only found once.
+    void StartOption(int chosenItemIndex, int optionNodeIndex)
+    {
+        if (!IsExactItem(chosenItemIndex))
+        {
+            if (optionNodeIndex == chosenItemIndex)
+            {
+                // Leave the item alone from now on
+                if (m_itemBounds[chosenItemIndex].bound != 0)
+                {
+                    m_items[m_items[chosenItemIndex].leftItemIndex].rightItemIndex = m_items[chosenItemIndex].rightItemIndex;
+                    m_items[m_items[chosenItemIndex].rightItemIndex].leftItemIndex = m_items[chosenItemIndex].leftItemIndex;
+                    m_stats.LinkUpdates(2);
+                }
+                return;
+            }
+
+            TweakOption(optionNodeIndex, chosenItemIndex);
+            m_tweakedNodeIndices.push_back(optionNodeIndex);
+        }
+
+        CoverOptionItems(optionNodeIndex);
+        if (!m_optionTaken.empty())
+            m_optionTaken[m_nodeOptionIndices[optionNodeIndex]] = 1;
+    }
+
+    // Undo StartOption. Tweaked options stay tweaked until LeaveItem.
+    void StopOption(int chosenItemIndex, int optionNodeIndex)
+    {
+        if (optionNodeIndex != chosenItemIndex)
+        {
+            UncoverOptionItems(optionNodeIndex);
+            if (!m_optionTaken.empty())
+                m_optionTaken[m_nodeOptionIndices[optionNodeIndex]] = 0;
+        }
+        else if (m_itemBounds[chosenItemIndex].bound != 0)
+        {
+            m_items[m_items[chosenItemIndex].leftItemIndex].rightItemIndex = TIndex(chosenItemIndex);
+            m_items[m_items[chosenItemIndex].rightItemIndex].leftItemIndex = TIndex(chosenItemIndex);
+            m_stats.LinkUpdates(2);
+        }
+    }
+
+    // Remove an option from the list of an item with multiplicities. If the item isn't covered, the option is still
+    // in the lists of its other items, so it gets hidden from those too.
+    void TweakOption(int optionNodeIndex, int itemIndex)
+    {
+        if (m_itemBounds[itemIndex].bound != 0)
+            HideOption(optionNodeIndex);
+
+        m_nodes[m_nodes[optionNodeIndex].upNodeIndex].downNodeIndex = m_nodes[optionNodeIndex].downNodeIndex;
+        m_nodes[m_nodes[optionNodeIndex].downNodeIndex].upNodeIndex = m_nodes[optionNodeIndex].upNodeIndex;
+        m_items[itemIndex].optionCount--;
+        m_stats.LinkUpdates(2);
+    }
+
+    // Undo TweakOption
+    void UntweakOption(int optionNodeIndex, int itemIndex)
+    {
+        m_nodes[m_nodes[optionNodeIndex].upNodeIndex].downNodeIndex = TIndex(optionNodeIndex);
+        m_nodes[m_nodes[optionNodeIndex].downNodeIndex].upNodeIndex = TIndex(optionNodeIndex);
+        m_items[itemIndex].optionCount++;
+        m_stats.LinkUpdates(2);
+
+        if (m_itemBounds[itemIndex].bound != 0)
+            UnhideOption(optionNodeIndex);
+    }
+
+    // Cover each item from this option, except the item it was chosen for.
+    // Knuth calls this committing the items.
+    void CoverOptionItems(int optionNodeIndex)
+    {
+        for (int nodeIndex = optionNodeIndex + 1; nodeIndex != optionNodeIndex; nodeIndex++)
+        {
+            if (m_nodes[nodeIndex].itemIndex == c_spacer)
+            {
+                nodeIndex = m_nodes[nodeIndex].upNodeIndex;
+                continue;
+            }
+
+            // Primary items use up one of their bound, and are covered when it's all used.
+            // Uncolored secondary items are covered. Colored ones are purified, unless an earlier option already did that.
+            int itemIndex = m_nodes[nodeIndex].itemIndex;
+            if (itemIndex < m_firstOptionalItem)
+            {
+                if (UseBound(itemIndex))
+                    CoverItem(itemIndex);
+            }
+            else if (!m_hasColors || m_nodeColors[nodeIndex] == 0)
+                CoverItem(itemIndex);
+            else if (m_nodeColors[nodeIndex] > 0)
+                PurifyItem(nodeIndex);
+        }
+    }
+
+    // Uncover each item from this option, except the item it was chosen for, in the reverse order of CoverOptionItems
+    void UncoverOptionItems(int optionNodeIndex)
+    {
+        for (int nodeIndex = optionNodeIndex - 1; nodeIndex != optionNodeIndex; nodeIndex--)
+        {
+            if (m_nodes[nodeIndex].itemIndex == c_spacer)
+            {
+                nodeIndex = m_nodes[nodeIndex].downNodeIndex;
+                continue;
+            }
+
+            int itemIndex = m_nodes[nodeIndex].itemIndex;
+            if (itemIndex < m_firstOptionalItem)
+            {
+                if (ReleaseBound(itemIndex))
+                    UncoverItem(itemIndex);
+            }
+            else if (!m_hasColors || m_nodeColors[nodeIndex] == 0)
+                UncoverItem(itemIndex);
+            else if (m_nodeColors[nodeIndex] > 0)
+                UnpurifyItem(nodeIndex);
+        }
+    }
+
+    // Get the first option node to try for the item chosen at the current level.
+    // If we are exhaustive, we can try options top to bottom. Otherwise we will try options in a randomized order.
+    int FirstOptionNode(int chosenItemIndex)
+    {
+        SearchLevel& searchLevel = m_searchLevels[m_level];
+        searchLevel.optionNumber = 0;
+
+        if (EXHAUSTIVE)
+            return m_nodes[chosenItemIndex].downNodeIndex;
+
+        // The options go in the buffer after the previous level's, which only has to grow if this is deeper than it has been
+        int start = OptionOrderStart();
+        int count = m_items[chosenItemIndex].optionCount;
+        if (start + count > (int)m_optionOrders.size())
+            m_optionOrders.resize(std::max(size_t(start + count), m_optionOrders.size() * 2));
+        searchLevel.optionOrderStart = start;
+        searchLevel.optionOrderCount = count;
+
+        int* options = &m_optionOrders[start];
+        int optionCount = 0;
+        for (int optionNodeIndex = m_nodes[chosenItemIndex].downNodeIndex; optionNodeIndex != chosenItemIndex; optionNodeIndex = m_nodes[optionNodeIndex].downNodeIndex)
+            options[optionCount++] = optionNodeIndex;
+
+        return (count == 0) ? chosenItemIndex : TakeRandomOption(0);
+    }
+
+    // Get the option node to try after this one at the current level. Returns the item index when there are no more.
+    int NextOptionNode(int chosenItemIndex, int optionNodeIndex)
+    {
+        int optionNumber = ++m_searchLevels[m_level].optionNumber;
+
+        if (EXHAUSTIVE)
+            return m_nodes[optionNodeIndex].downNodeIndex;
+
+        if (optionNumber >= m_searchLevels[m_level].optionOrderCount)
+            return chosenItemIndex;
+        return TakeRandomOption(optionNumber);
+    }
+
+    // The shuffle is done one option at a time, as they are tried. A random option from the ones not tried yet is
+    // swapped into place, so a search that stops early doesn't pay to shuffle the options it never gets to.
+    int TakeRandomOption(int optionNumber)
+    {
+        int* options = &m_optionOrders[m_searchLevels[m_level].optionOrderStart];
+        int count = m_searchLevels[m_level].optionOrderCount;
+        int swapIndex = optionNumber + int(m_rng.Below(uint32_t(count - optionNumber)));
+        std::swap(options[optionNumber], options[swapIndex]);
+        return options[optionNumber];
+    }
+
+    int OptionOrderStart() const
+    {
+        return (m_level == 0) ? 0 : m_searchLevels[m_level - 1].optionOrderStart + m_searchLevels[m_level - 1].optionOrderCount;
+    }
+
+    void ShowAttempt(int tryOptionNodeIndex) const
+    {
+        int optionIndex = m_nodeOptionIndices[tryOptionNodeIndex];
+
+        for (int i = 0; i < m_level; ++i)
+            printf("  ");
+        printf("[%i] option %i: ", m_searchLevels[m_level].optionNumber, optionIndex);
+
+        // Show the names of the items in this option
+        PrintOptionItems(optionIndex);
+        printf("\n");
+    }
+
+    // Make the search stack ready to start a search at level 0.
+    // Every level covers at least one primary item, so the stack never gets deeper than the number of primary items.
+    // With multiplicities, every level either takes an option, or leaves an item alone, so bounds much bigger than the
+    // model don't make the stack any bigger.
+    void ResetSearch()
+    {
+        int maxLevels = m_firstOptionalItem + 1;
+        if (m_hasMultiplicities)
+        {
+            int64_t boundTotal = 0;
+            for (int itemIndex = 0; itemIndex < m_firstOptionalItem; ++itemIndex)
+                boundTotal += int64_t(m_itemBounds[itemIndex].bound);
+            maxLevels += int(std::min<int64_t>(boundTotal, m_optionCount));
+        }
+        m_searchLevels.assign(maxLevels, SearchLevel());
+        m_tweakedNodeIndices.clear();
+        m_tweakedNodeIndices.reserve(m_optionCount);
+        if (!EXHAUSTIVE)
+            m_optionOrders.resize(std::max(m_optionOrders.size(), size_t(m_optionCount)));
+        if (m_countSolutions)
+        {
+            m_levelCounts.resize(maxLevels);
+            m_levelCountKeys.resize(maxLevels);
+            m_levelCountKeyed.resize(maxLevels);
+            m_levelZddNodes.resize(maxLevels);
+            m_levelZddBranches.resize(maxLevels);
+        }
+        if (!m_symmetryInverses.empty())
+        {
+            m_levelSymmetryPositions.resize(size_t(maxLevels) * m_symmetryInverses.size());
+            m_levelSymmetryPositionsValid.assign(maxLevels, 0);
+        }
+        m_solutionOptionIndices.reserve(maxLevels);
+        m_level = 0;
+        m_searchState = SearchState::EnterLevel;
+    }
+
+    // Make m_solutionOptionIndices the options taken at the first levelCount levels.
+    // Levels where an item was left alone don't have an option.
+    void SetSolutionOptions(int levelCount)
+    {
+        m_solutionOptionIndices.clear();
+        for (int level = 0; level < levelCount; ++level)
+        {
+            int optionIndex = m_nodeOptionIndices[m_searchLevels[level].optionNodeIndex];
+            if (optionIndex >= 0)
+                m_solutionOptionIndices.push_back(optionIndex);
+        }
+    }
+
+    // True if SolvePlain can do this search: a full exhaustive search of an exact cover problem without colors or
+    // multiplicities, that doesn't need to stop anywhere or look at the nodes it goes through.
+    bool IsPlainSearch() const
+    {
+        return EXHAUSTIVE && !SHOW_ALL_ATTEMPTS && !m_hasColors && !m_hasMultiplicities && m_searchState == SearchState::EnterLevel &&
+            m_splitLevel < 0 && !m_breakSymmetries && !m_countSolutions && !m_pauseAtSolutions && !m_writeCheckpoints &&
+            !m_hasSearchLimits && m_maxSolutions == 0;
+    }
+
+    // This is Knuth's algorithm X as a loop instead of recursion, with its steps labeled like his (X2 to X8).
+    // Items with multiplicities go through the same steps, the way his algorithm M does.
+    // While the loop runs, the level and the stack are in locals, and m_level is kept up to date for the helpers.
+    // m_searchState says where to go back in, so the loop can be left and entered again where it left off.
+    template <typename TSolutionLambdaFN>
+    void SolveInternal(const TSolutionLambdaFN& solutionLambda)
+    {
+        if (IsPlainSearch())
+        {
+            SolvePlain(solutionLambda);
+            return;
+        }
+
+        // The levels above here might have been entered by a path, without EnterLevel
+        std::fill(m_levelSymmetryPositionsValid.begin(), m_levelSymmetryPositionsValid.end(), 0);
+
+        SearchLevel* levels = m_searchLevels.data();
+        int level = m_level;
+        switch (m_searchState)
+        {
+            case SearchState::EnterLevel: goto enterLevel;
+            case SearchState::TryOption: goto tryOption;
+            case SearchState::LeaveLevel: goto leaveLevel;
+            case SearchState::Done: return;
+        }
+
+    // X2. We just got to this level. Report a solution, or choose an item (X3) and cover it (X4).
+    enterLevel:
+        {
+            m_level = level;
+            m_maxRecursionDepth = std::max(m_maxRecursionDepth, level - m_presolveForcedCount);
+            levels[level].branchCount = 0;
+
+            // When splitting the search into tasks, record how we got here instead of going deeper.
+            // Solutions above the split level are recorded as tasks too.
+            bool isSolution = m_items[m_rootItemIndex].rightItemIndex >= m_firstOptionalItem;
+            if (m_splitLevel >= 0 && (isSolution || level == m_splitLevel))
+            {
+                m_splitTasks->push_back(OptionNumbers(level));
+                goto leaveLevel;
+            }
+
+            // Tasks count the node they start at, so nodes at the split level are only counted once
+            m_stats.VisitNode(level);
+
+            // Backtrack if a symmetry shows that everything below here isn't a lex leader
+            if (m_breakSymmetries && !m_countSolutions && !IsSymmetryLeader(isSolution))
+                goto leaveLevel;
+
+            // If we've found a solution, report it and backtrack
+            if (isSolution)
+            {
+                if (m_countSolutions)
+                {
+                    m_levelCounts[level] = 1;
+                    m_levelCountKeyed[level] = false;
+                    m_levelZddNodes[level] = 1;
+                    m_levelZddBranches[level].clear();
+                    m_solutionsFound++;
+                    goto leaveLevel;
+                }
+
+                SetSolutionOptions(level);
+                m_solutionsFound++;
+                solutionLambda(*this);
+
+                // Pulling solutions one at a time, so give this one back to the caller
+                if (m_pauseAtSolutions)
+                {
+                    m_searchState = SearchState::LeaveLevel;
+                    return;
+                }
+                goto leaveLevel;
+            }
+
+            // When counting, use the count from the last time the search was in this state, if there was one
+            if (m_countSolutions && StartCountingLevel())
+                goto leaveLevel;
+
+            // X3. If we found an item without any valid options, backtrack.
+            int chosenItemIndex = ChooseItem();
+            if (chosenItemIndex < 0)
+            {
+                m_stats.DeadEnd(level);
+                goto leaveLevel;
+            }
+
+            if (SHOW_ALL_ATTEMPTS)
+            {
+                for (int i = 0; i < level; ++i)
+                    printf("  ");
+                printf("Trying %i options to cover item %s\n", int(m_items[chosenItemIndex].optionCount), m_itemNames[chosenItemIndex].name);
+            }
+
+            // X4. Mark this item as covered, or use up some of its bound.
+            // We aren't sure which of the options we are going to use, but it will be one of the options
+            EnterItem(chosenItemIndex);
+            m_stats.Branch(level, levels[level].branchCount);
+            levels[level].optionNodeIndex = FirstOptionNode(chosenItemIndex);
+        }
+
+    // X5. Try the option this level is at, or if there are no options left, leave the item (X7) and the level.
+    tryOption:
+        {
+            // For non exhaustive, stop after finding the first solution
+            SearchLevel& searchLevel = levels[level];
+            int chosenItemIndex = searchLevel.itemIndex;
+            int tryOptionNodeIndex = searchLevel.optionNodeIndex;
+            bool stop = (!EXHAUSTIVE && m_solutionsFound > 0) || (m_maxSolutions > 0 && m_solutionsFound >= m_maxSolutions) || (m_hasSearchLimits && SearchLimitReached());
+            if (stop || !CanTryOption(chosenItemIndex, tryOptionNodeIndex))
+            {
+                LeaveItem(chosenItemIndex);
+                goto leaveLevel;
+            }
+
+            if (m_writeCheckpoints && --m_checkpointCountdown <= 0)
+                CheckpointIfDue();
+
+            if (tryOptionNodeIndex != chosenItemIndex)
+            {
+                if (SHOW_ALL_ATTEMPTS)
+                    ShowAttempt(tryOptionNodeIndex);
+
+                m_attempts++;
+                if ((m_attempts % PRINT_PROGRESS_RATE()) == 0)
+                    PrintProgress();
+            }
+            else if (SHOW_ALL_ATTEMPTS)
+            {
+                for (int i = 0; i < level; ++i)
+                    printf("  ");
+                printf("[%i] leave item %s alone\n", searchLevel.optionNumber, m_itemNames[chosenItemIndex].name);
+            }
+
+            StartOption(chosenItemIndex, tryOptionNodeIndex);
+            level++;
+            goto enterLevel;
+        }
+
+    // X8. Go back up a level. X6: undo the option that was being tried there, and move on to the next one.
+    leaveLevel:
+        {
+            if (m_countSolutions)
+                FinishCountingLevel();
+
+            if (level == m_baseLevel)
+            {
+                m_searchState = SearchState::Done;
+                return;
+            }
 
-        if (milliseconds < 10)
-            sprintf_s(buffer, ".00%i", milliseconds);
-        else if (milliseconds < 100)
-            sprintf_s(buffer, ".0%i", milliseconds);
-        else
-            sprintf_s(buffer, ".%i", milliseconds);
-        ret += buffer;
+            level--;
+            m_level = level;
+            SearchLevel& searchLevel = levels[level];
+            int chosenItemIndex = searchLevel.itemIndex;
+            int optionNodeIndex = searchLevel.optionNodeIndex;
+            StopOption(chosenItemIndex, optionNodeIndex);
 
-        return ret;
+            // Leaving the item alone is always the last thing to try
+            if (optionNodeIndex == chosenItemIndex)
+            {
+                LeaveItem(chosenItemIndex);
+                goto leaveLevel;
+            }
+
+            searchLevel.optionNodeIndex = NextOptionNode(chosenItemIndex, optionNodeIndex);
+            goto tryOption;
+        }
     }
 
-    void CoverItem(int itemIndex)
+    // SolveInternal for plain searches, which are most of them. Every level covers one item, and every option covers
+    // all of its items, so Knuth's steps come down to covering and uncovering, which are written out here along with
+    // the rest of the loop, instead of going through the helpers that handle colors, multiplicities and the rest.
+    // Levels are only kept in m_searchLevels for Progress() and solutions. Everything else stays in locals.
+    template <typename TSolutionLambdaFN>
+    void SolvePlain(const TSolutionLambdaFN& solutionLambda)
     {
-        // Remove this item from the item list
-        m_items[m_items[itemIndex].leftItemIndex].rightItemIndex = m_items[itemIndex].rightItemIndex;
-        m_items[m_items[itemIndex].rightItemIndex].leftItemIndex = m_items[itemIndex].leftItemIndex;
+        const Node<TIndex>* nodes = m_nodes.data();
+        const Item<TIndex>* items = m_items.data();
+        SearchLevel* levels = m_searchLevels.data();
+        int level = m_level;
+
+    // X2. We just got to this level. If every primary item is covered, report the solution and backtrack.
+    enterLevel:
+        m_maxRecursionDepth = std::max(m_maxRecursionDepth, level - m_presolveForcedCount);
+        levels[level].branchCount = 0;
+        m_stats.VisitNode(level);
+        if (items[m_rootItemIndex].rightItemIndex >= m_firstOptionalItem)
+        {
+            m_level = level;
+            SetSolutionOptions(level);
+            m_solutionsFound++;
+            solutionLambda(*this);
+            goto leaveLevel;
+        }
 
-        if (SHOW_ALL_ATTEMPTS)
+        // X3 and X4. Choose an item and cover it, or backtrack if some item can't be covered anymore
         {
-            for (int i = 0; i <= SScopedRecursionCounter::s_recursionLevel; ++i)
-                printf("  ");
-            printf("Covering %s\n", m_items[itemIndex].name);
+            int chosenItemIndex = ChooseItem<false>();
+            if (chosenItemIndex < 0)
+            {
+                m_stats.DeadEnd(level);
+                goto leaveLevel;
+            }
+
+            CoverItem<false>(chosenItemIndex);
+            SearchLevel& searchLevel = levels[level];
+            searchLevel.itemIndex = chosenItemIndex;
+            searchLevel.optionNodeIndex = nodes[chosenItemIndex].downNodeIndex;
+            searchLevel.optionNumber = 0;
+            searchLevel.branchCount = items[chosenItemIndex].optionCount;
+            m_stats.Branch(level, searchLevel.branchCount);
         }
 
-        // Remove all options of this item from the lists of the other items
-        int optionNodeIndex = m_nodes[itemIndex].downNodeIndex;
-        while (optionNodeIndex != itemIndex)
+    // X5. Try the option this level is at by covering its other items, or if there are none left, uncover the item (X7).
+    tryOption:
         {
-            if (SHOW_ALL_ATTEMPTS)
+            int optionNodeIndex = levels[level].optionNodeIndex;
+            if (optionNodeIndex == levels[level].itemIndex)
             {
-                for (int i = 0; i <= SScopedRecursionCounter::s_recursionLevel + 1; ++i)
-                    printf("  ");
-                int printNodeIndex = optionNodeIndex;
-                while (m_nodes[printNodeIndex].itemIndex != -1)
-                    printNodeIndex--;
+                UncoverItem<false>(optionNodeIndex);
+                goto leaveLevel;
+            }
 
-                printNodeIndex++;
-                printf("Removing ");
-                while (m_nodes[printNodeIndex].itemIndex != -1)
-                {
-                    printf("%s ", m_items[m_nodes[printNodeIndex].itemIndex].name);
-                    printNodeIndex++;
-                }
-                printf("\n");
+            m_attempts++;
+            if ((m_attempts % PRINT_PROGRESS_RATE()) == 0)
+            {
+                m_level = level;
+                PrintProgress();
             }
 
-            int nodeIndex = optionNodeIndex + 1;
-            while (nodeIndex != optionNodeIndex)
+            for (int nodeIndex = optionNodeIndex + 1; nodeIndex != optionNodeIndex; nodeIndex++)
             {
-                // if we reached the end of the list, wrap around
-                if (m_nodes[nodeIndex].itemIndex == -1)
+                if (nodes[nodeIndex].itemIndex == c_spacer)
                 {
-                    nodeIndex = m_nodes[nodeIndex].upNodeIndex + 1;
+                    nodeIndex = nodes[nodeIndex].upNodeIndex;
                     continue;
                 }
+                CoverItem<false>(nodes[nodeIndex].itemIndex);
+            }
 
-                // Remove the option from this item's list
-                m_nodes[m_nodes[nodeIndex].upNodeIndex].downNodeIndex = m_nodes[nodeIndex].downNodeIndex;
-                m_nodes[m_nodes[nodeIndex].downNodeIndex].upNodeIndex = m_nodes[nodeIndex].upNodeIndex;
+            level++;
+            goto enterLevel;
+        }
 
-                // Remember that an option has been removed
-                m_items[m_nodes[nodeIndex].itemIndex].optionCount--;
+    // X8. Go back up a level. X6: uncover the items of the option that was tried there, and move on to the next one.
+    leaveLevel:
+        if (level == m_baseLevel)
+        {
+            m_level = level;
+            m_searchState = SearchState::Done;
+            return;
+        }
 
-                if (SHOW_ALL_ATTEMPTS && m_items[m_nodes[nodeIndex].itemIndex].optionCount == 0)
+        level--;
+        {
+            SearchLevel& searchLevel = levels[level];
+            int optionNodeIndex = searchLevel.optionNodeIndex;
+            for (int nodeIndex = optionNodeIndex - 1; nodeIndex != optionNodeIndex; nodeIndex--)
+            {
+                if (nodes[nodeIndex].itemIndex == c_spacer)
                 {
-                    for (int i = 0; i <= SScopedRecursionCounter::s_recursionLevel; ++i)
-                        printf("  ");
-                    printf("Covering %s resulted in %s having no valid options\n", m_items[itemIndex].name, m_items[m_nodes[nodeIndex].itemIndex].name);
+                    nodeIndex = nodes[nodeIndex].downNodeIndex;
+                    continue;
                 }
-
-                // go to the next node in the option
-                nodeIndex++;
+                UncoverItem<false>(nodes[nodeIndex].itemIndex);
             }
 
-            // go to the next option
-            optionNodeIndex = m_nodes[optionNodeIndex].downNodeIndex;
+            searchLevel.optionNumber++;
+            searchLevel.optionNodeIndex = nodes[optionNodeIndex].downNodeIndex;
         }
+        goto tryOption;
     }
 
-    void UncoverItem(int itemIndex)
+    // Start counting the solutions below the current level.
+    // Returns true if the count is already known from the cache.
+    // While options are tweaked out of an item's list, the remaining items don't describe the state fully, so
+    // those states are counted without the cache.
+    bool StartCountingLevel()
     {
-        // Add this item back to the list
-        m_items[m_items[itemIndex].leftItemIndex].rightItemIndex = itemIndex;
-        m_items[m_items[itemIndex].rightItemIndex].leftItemIndex = itemIndex;
+        m_levelCounts[m_level] = 0;
+        m_levelCountKeyed[m_level] = false;
+        m_levelZddNodes[m_level] = 0;
+        m_levelZddBranches[m_level].clear();
+        if (!m_tweakedNodeIndices.empty())
+            return false;
+
+        std::vector<uint32_t>& key = m_levelCountKeys[m_level];
+        key.assign((m_rootItemIndex + 31) / 32, 0);
+        for (int itemIndex = m_items[m_rootItemIndex].rightItemIndex; itemIndex != m_rootItemIndex; itemIndex = m_items[itemIndex].rightItemIndex)
+        {
+            key[itemIndex / 32] |= 1u << (itemIndex % 32);
+            if (m_hasColors && itemIndex >= m_firstOptionalItem)
+                key.push_back(uint32_t(m_nodeColors[itemIndex]));
+            if (m_hasMultiplicities && itemIndex < m_firstOptionalItem)
+                key.push_back(uint32_t(m_itemBounds[itemIndex].bound));
+        }
+
+        auto it = m_countCache.find(key);
+        if (it != m_countCache.end())
+        {
+            m_levelCounts[m_level] = it->second.count;
+            m_levelZddNodes[m_level] = it->second.zddNode;
+            m_countCacheHits++;
+            return true;
+        }
+
+        m_levelCountKeyed[m_level] = true;
+        return false;
+    }
+
+    // The count for the current level is done. Cache it, and add it to the level above.
+    void FinishCountingLevel()
+    {
+        if (m_zdd)
+            FinishZddNode();
+
+        if (m_levelCountKeyed[m_level])
+            m_countCache.emplace(m_levelCountKeys[m_level], CountCacheEntry{ m_levelCounts[m_level], m_levelZddNodes[m_level] });
+
+        if (m_level > m_baseLevel)
+            m_levelCounts[m_level - 1] += m_levelCounts[m_level];
+    }
 
-        // Add all options of this item back to the lists of the other items
-        int optionNodeIndex = m_nodes[itemIndex].downNodeIndex;
-        while (optionNodeIndex != itemIndex)
+    // Make the ZDD node for the current level as a chain of the options tried, each one's lo being the next.
+    // The chain is made from the end, so nodes only point to nodes that were made before them.
+    // Leaving an item alone is the last branch when it happens, and doesn't add an option.
+    void FinishZddNode()
+    {
+        std::vector<std::pair<int, uint32_t>>& branches = m_levelZddBranches[m_level];
+        if (!branches.empty())
         {
-            // Start just beyond this node, and go through all the other nodes until we reach this one again
-            int nodeIndex = optionNodeIndex + 1;
-            while (nodeIndex != optionNodeIndex)
+            uint32_t zddNode = 0;
+            for (size_t index = branches.size(); index-- > 0;)
             {
-                // if we reached the end of the list, wrap around to the beginning again
-                if (m_nodes[nodeIndex].itemIndex == -1)
+                if (branches[index].first < 0)
                 {
-                    nodeIndex = m_nodes[nodeIndex].upNodeIndex + 1;
+                    zddNode = branches[index].second;
                     continue;
                 }
 
-                // Add the option back into this item's list
-                m_nodes[m_nodes[nodeIndex].upNodeIndex].downNodeIndex = nodeIndex;
-                m_nodes[m_nodes[nodeIndex].downNodeIndex].upNodeIndex = nodeIndex;
+                m_zdd->nodes.push_back(SolutionZdd::Node{ branches[index].first, zddNode, branches[index].second });
+                zddNode = uint32_t(m_zdd->nodes.size() - 1);
+            }
+            m_levelZddNodes[m_level] = zddNode;
+        }
 
-                // Remember that an option has been restored
-                m_items[m_nodes[nodeIndex].itemIndex].optionCount++;
+        // Levels are entered by taking the option on top of the solution stack at the level above
+        if (m_level > m_baseLevel && m_levelZddNodes[m_level] != 0)
+            m_levelZddBranches[m_level - 1].emplace_back(m_nodeOptionIndices[m_searchLevels[m_level - 1].optionNodeIndex], m_levelZddNodes[m_level]);
+    }
 
-                // go to the next node in the option
-                nodeIndex++;
-            }
+    // The search for CountSolutions and MakeSolutionZdd
+    void CountSolutionsInternal()
+    {
+        m_countSolutions = true;
+        ResetSearch();
+        m_countCache.clear();
+        m_countCacheHits = 0;
+        auto dummy = [](const auto&) {};
+        SolveInternal(dummy);
+        m_countSolutions = false;
+    }
+
+    // BitSolver does the same search as SolveInternal, for models that it can handle
+    bool UseBitSolver() const
+    {
+        return USE_BIT_SOLVER() && EXHAUSTIVE && !SHOW_ALL_ATTEMPTS && !m_hasColors && !m_hasMultiplicities && !m_hasSearchLimits && m_checkpointFileName.empty() && !TSearchStats::c_enabled && !m_presolve && m_symmetryInverses.empty() && std::is_same_v<TItemHeuristic, MrvHeuristic> && BitSolver::Fits(m_rootItemIndex, m_optionCount);
+    }
 
-            // go to the next option
-            optionNodeIndex = m_nodes[optionNodeIndex].downNodeIndex;
+    // Check the search limits. The attempt budget is checked every time, and the stop token and the deadline are
+    // checked every c_searchLimitCheckRate calls, since reading the clock isn't free.
+    // Once a limit is reached, this keeps returning true so the search unwinds all the way up.
+    bool SearchLimitReached()
+    {
+        if (m_stopReason != StopReason::None)
+            return true;
+
+        if (m_searchLimits.maxAttempts > 0 && m_attempts - m_searchLimitAttemptsStart >= m_searchLimits.maxAttempts)
+        {
+            m_stopReason = StopReason::MaxAttempts;
+        }
+        else if (--m_searchLimitCheckCountdown <= 0)
+        {
+            m_searchLimitCheckCountdown = c_searchLimitCheckRate;
+            if (m_searchLimits.stopToken.stop_requested())
+                m_stopReason = StopReason::StopRequested;
+            else if (m_searchLimits.maxSeconds > 0.0 && std::chrono::high_resolution_clock::now() >= m_deadline)
+                m_stopReason = StopReason::Deadline;
         }
+
+        if (m_stopReason == StopReason::None)
+            return false;
+
+        // Remember the option number each level was about to try
+        m_stopPath = OptionNumbers(m_level + 1);
+        return true;
     }
 
-    void PrintProgress()
+    // A requested stop is the caller being done with the search, like after finding what it wanted, so where the
+    // search was isn't interesting and the path is left out.
+    void PrintStopReason() const
     {
-        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(now - m_start);
-        std::string elapsed = MakeDurationString((float)timeSpan.count());
-        printf("[%s] %zu solutions. Pos: ", elapsed.c_str(), m_solutionsFound);
-        for (int index : m_solutionOptionNodeIndices)
-            printf("%i ", index);
-        printf(" (%zu total nodes)\n", m_nodes.size());
+        if (m_stopReason == StopReason::None)
+            return;
+
+        static const char* c_stopReasonNames[] = { "", "stop requested", "max attempts reached", "deadline reached" };
+        printf("The search stopped early (%s).", c_stopReasonNames[(int)m_stopReason]);
+        if (m_stopReason != StopReason::StopRequested)
+        {
+            printf(" Option numbers it was at: ");
+            for (int optionNumber : m_stopPath)
+                printf("%i ", optionNumber);
+        }
+        printf("\n");
     }
 
-    template <typename TSolutionLambdaFN>
-    void SolveInternal(const TSolutionLambdaFN& solutionLambda)
+    void StartCheckpoints()
     {
-        SScopedRecursionCounter recursionCounter;
-        m_maxRecursionDepth = std::max(m_maxRecursionDepth, recursionCounter.s_recursionLevel);
+        m_writeCheckpoints = EXHAUSTIVE && TItemHeuristic::c_stateless && !m_checkpointFileName.empty();
+        m_checkpointCountdown = c_searchLimitCheckRate;
+        m_nextCheckpoint = std::chrono::high_resolution_clock::now() + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(m_checkpointSeconds));
+    }
 
-        // For non exhaustive, return after finding the first solution
-        if (!EXHAUSTIVE && m_solutionsFound > 0)
+    // Write the last checkpoint. If a search limit stopped the search, the checkpoint is where it stopped.
+    void FinishCheckpoints()
+    {
+        if (!m_writeCheckpoints)
             return;
 
-        // If we've found a solution, print it out
-        if (m_items[m_rootItemIndex].rightItemIndex >= m_firstOptionalItem)
-        {
-            m_solutionsFound++;
-            solutionLambda(*this);
+        m_writeCheckpoints = false;
+        WriteCheckpoint(m_stopPath, m_stopReason == StopReason::None);
+    }
+
+    // Called before trying an option, so the checkpoint has the option number each level is at, with the current
+    // level's option not tried yet
+    void CheckpointIfDue()
+    {
+        m_checkpointCountdown = c_searchLimitCheckRate;
+
+        std::chrono::high_resolution_clock::time_point now = std::chrono::high_resolution_clock::now();
+        if (now < m_nextCheckpoint)
             return;
+
+        WriteCheckpoint(OptionNumbers(m_level + 1), false);
+        m_nextCheckpoint = now + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(m_checkpointSeconds));
+    }
+
+    void WriteCheckpoint(std::span<const int> optionNumbers, bool finished) const
+    {
+        std::chrono::duration<double> timeSpan = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::high_resolution_clock::now() - m_start);
+
+        SearchCheckpoint checkpoint;
+        checkpoint.itemCount = uint32_t(m_rootItemIndex);
+        checkpoint.optionCount = uint32_t(m_optionCount);
+        checkpoint.nodeCount = uint32_t(m_nodes.size());
+        checkpoint.finished = finished;
+        checkpoint.solutionsFound = m_solutionsFound;
+        checkpoint.attempts = m_attempts;
+        checkpoint.maxRecursionDepth = m_maxRecursionDepth;
+        checkpoint.seconds = timeSpan.count();
+        if (!finished)
+            checkpoint.optionNumbers.assign(optionNumbers.begin(), optionNumbers.end());
+        checkpoint.WriteToFile(m_checkpointFileName.c_str());
+    }
+
+    // Go back to where a checkpoint was: take the option number at each level but the last, and get ready to try
+    // the last level's option number. Returns false, with the model put back, if the path isn't in the search tree.
+    bool EnterCheckpointPath(const std::vector<int>& optionNumbers)
+    {
+        ResetSearch();
+        for (size_t pathIndex = 0; pathIndex < optionNumbers.size(); ++pathIndex)
+        {
+            int chosenItemIndex = ChooseItem();
+            if (chosenItemIndex < 0)
+            {
+                LeavePath();
+                return false;
+            }
+
+            EnterItem(chosenItemIndex);
+            int optionNumber = optionNumbers[pathIndex];
+            bool lastLevel = pathIndex + 1 == optionNumbers.size();
+            if (optionNumber < 0 || optionNumber > (lastLevel ? int(m_items[chosenItemIndex].optionCount) : m_searchLevels[m_level].branchCount - 1))
+            {
+                LeaveItem(chosenItemIndex);
+                LeavePath();
+                return false;
+            }
+
+            if (lastLevel)
+            {
+                m_searchLevels[m_level].optionNodeIndex = FindOptionNumber(chosenItemIndex, optionNumber);
+                m_searchState = SearchState::TryOption;
+                return true;
+            }
+
+            StartOptionNumber(chosenItemIndex, optionNumber);
+            m_level++;
         }
 
-        // Try the item with the lowest option count.
-        // Any method for choosing from the remaining items will handle all solutions
-        // but this method can make for a smaller search tree.
-        int chosenItemIndex = m_items[m_rootItemIndex].rightItemIndex;
+        // An empty path is the start of the search
+        return true;
+    }
+
+    template <typename TSolutionLambdaFN>
+    void SolveWithBitSolver(const TSolutionLambdaFN& solutionLambda)
+    {
+        BitSolver bitSolver;
+        bitSolver.Init(m_rootItemIndex, m_firstOptionalItem, m_optionCount);
+        for (int optionIndex = 0; optionIndex < m_optionCount; ++optionIndex)
         {
-            int itemIndex = m_items[m_rootItemIndex].rightItemIndex;
-            int lowestItemIndex = itemIndex;
-            int lowestItemCount = m_items[itemIndex].optionCount;
+            for (int nodeIndex = m_optionNodeIndices[optionIndex] + 1; nodeIndex < (int)m_nodes.size() && m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+                bitSolver.AddOptionItem(optionIndex, m_nodes[nodeIndex].itemIndex);
+        }
 
-            itemIndex = m_items[itemIndex].rightItemIndex;
-            while (itemIndex < m_firstOptionalItem)
+        // Hand solutions out through this solver, so solution lambdas work the same either way
+        size_t solutionsFound = m_solutionsFound;
+        size_t attempts = m_attempts;
+        bitSolver.Solve([&](const BitSolver& bitSolver)
             {
-                if (m_items[itemIndex].optionCount < lowestItemCount)
+                std::span<const int> options = bitSolver.SolutionOptions();
+                m_solutionOptionIndices.assign(options.begin(), options.end());
+                m_solutionsFound = solutionsFound + bitSolver.m_solutionsFound;
+                solutionLambda(*this);
+            },
+            // Show progress from the bitset search's levels, the same way SolveInternal does from its own
+            [&](const BitSolver& bitSolver)
+            {
+                std::span<const int> optionNumbers = bitSolver.LevelOptionNumbers();
+                std::span<const int> branchCounts = bitSolver.LevelBranchCounts();
+                if (m_searchLevels.size() < optionNumbers.size())
+                    m_searchLevels.resize(optionNumbers.size());
+                for (size_t level = 0; level < optionNumbers.size(); ++level)
                 {
-                    lowestItemCount = m_items[itemIndex].optionCount;
-                    lowestItemIndex = itemIndex;
+                    m_searchLevels[level].optionNumber = optionNumbers[level];
+                    m_searchLevels[level].branchCount = branchCounts[level];
                 }
+                m_level = int(optionNumbers.size()) - 1;
+                m_solutionsFound = solutionsFound + bitSolver.m_solutionsFound;
+                m_attempts = attempts + bitSolver.m_attempts;
+                PrintProgress();
+            }
+        );
+
+        m_level = 0;
+        m_solutionsFound = solutionsFound + bitSolver.m_solutionsFound;
+        m_attempts = attempts + bitSolver.m_attempts;
+        m_maxRecursionDepth = std::max(m_maxRecursionDepth, bitSolver.m_maxRecursionDepth);
+    }
+
+    // The option number each of the first levelCount levels is at, which is the path from the top of the search tree
+    std::vector<int> OptionNumbers(int levelCount) const
+    {
+        std::vector<int> optionNumbers(levelCount);
+        for (int level = 0; level < levelCount; ++level)
+            optionNumbers[level] = m_searchLevels[level].optionNumber;
+        return optionNumbers;
+    }
+
+    // Run the search down to splitLevel, recording the option numbers taken at each level to get to every node there.
+    void CollectTasks(int splitLevel, std::vector<std::vector<int>>& tasks)
+    {
+        tasks.clear();
+        m_splitLevel = splitLevel;
+        m_splitTasks = &tasks;
+        ResetSearch();
+        auto dummy = [](const auto&) {};
+        SolveInternal(dummy);
+        m_splitLevel = -1;
+        m_splitTasks = nullptr;
+    }
 
-                itemIndex = m_items[itemIndex].rightItemIndex;
+    // Take the given option number at each level from the top of the search tree, covering as the search would.
+    void EnterPath(const std::vector<int>& optionNumbers)
+    {
+        ResetSearch();
+        for (int optionNumber : optionNumbers)
+        {
+            int chosenItemIndex = ChooseItem();
+            EnterItem(chosenItemIndex);
+            StartOptionNumber(chosenItemIndex, optionNumber);
+            m_level++;
+        }
+    }
+
+    // Take the given option number for the item entered at the current level
+    void StartOptionNumber(int chosenItemIndex, int optionNumber)
+    {
+        int optionNodeIndex = FindOptionNumber(chosenItemIndex, optionNumber);
+        m_searchLevels[m_level].optionNodeIndex = optionNodeIndex;
+        StartOption(chosenItemIndex, optionNodeIndex);
+    }
+
+    // Get the node of the given option number for the item entered at the current level.
+    // The options before this one would already have been tried, and tweaked out if the item has multiplicities.
+    int FindOptionNumber(int chosenItemIndex, int optionNumber)
+    {
+        int optionNodeIndex = FirstOptionNode(chosenItemIndex);
+        while (m_searchLevels[m_level].optionNumber < optionNumber)
+        {
+            if (!IsExactItem(chosenItemIndex))
+            {
+                TweakOption(optionNodeIndex, chosenItemIndex);
+                m_tweakedNodeIndices.push_back(optionNodeIndex);
             }
+            optionNodeIndex = NextOptionNode(chosenItemIndex, optionNodeIndex);
+        }
+        return optionNodeIndex;
+    }
 
-            chosenItemIndex = lowestItemIndex;
+    // Undo EnterPath, restoring the links to how they were before it
+    void LeavePath()
+    {
+        while (m_level > 0)
+            LeavePathLevel();
+    }
 
-            // If we found an item without any valid options, backtrack.
-            if (lowestItemCount == 0)
-                return;
+    // Undo the last level of EnterPath, or the last SelectOption
+    void LeavePathLevel()
+    {
+        m_level--;
+        int chosenItemIndex = m_searchLevels[m_level].itemIndex;
+        StopOption(chosenItemIndex, m_searchLevels[m_level].optionNodeIndex);
+        LeaveItem(chosenItemIndex);
+    }
+
+    void UnexcludeLastOption()
+    {
+        int firstNodeIndex = m_optionNodeIndices[m_excludedOptionIndices.back()] + 1;
+        m_excludedOptionIndices.pop_back();
+
+        int nodeIndex = firstNodeIndex;
+        while (m_nodes[nodeIndex].itemIndex != c_spacer)
+            nodeIndex++;
+
+        while (nodeIndex-- > firstNodeIndex)
+        {
+            const Node<TIndex>& node = m_nodes[nodeIndex];
+            m_nodes[node.upNodeIndex].downNodeIndex = TIndex(nodeIndex);
+            m_nodes[node.downNodeIndex].upNodeIndex = TIndex(nodeIndex);
+            m_items[node.itemIndex].optionCount++;
         }
+    }
 
-        if (SHOW_ALL_ATTEMPTS)
+    // True if every node of the option is still in its item's list, and none of its items are covered, so the option
+    // can still be taken. Covering an item leaves the options in its own list linked in, so both need checking.
+    bool IsOptionAvailable(int optionIndex) const
+    {
+        for (int nodeIndex = m_optionNodeIndices[optionIndex] + 1; m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
         {
-            for (int i = 0; i < recursionCounter.s_recursionLevel; ++i)
-                printf("  ");
-            printf("Trying %i options to cover item %s\n", m_items[chosenItemIndex].optionCount, m_items[chosenItemIndex].name);
+            int itemIndex = m_nodes[nodeIndex].itemIndex;
+            if (m_items[m_items[itemIndex].leftItemIndex].rightItemIndex != itemIndex || m_nodes[m_nodes[nodeIndex].upNodeIndex].downNodeIndex != nodeIndex)
+                return false;
         }
+        return true;
+    }
 
-        // Mark this item as covered.
-        // We aren't sure which of the options we are going to use, but it will be one of the options
-        CoverItem(chosenItemIndex);
+    // 1 if the search has taken the option, 0 if it can't anymore, or -1 if that isn't decided yet.
+    // At a solution, everything is decided. Options without primary items are never taken.
+    int OptionState(int optionIndex, bool final) const
+    {
+        if (m_optionTaken[optionIndex])
+            return 1;
+        if (final)
+            return 0;
 
-        // If we are exhaustive, we can try options top to bottom. Otherwise we will try options in a randomized order.
+        bool hasPrimaryItem = false;
+        for (int nodeIndex = m_optionNodeIndices[optionIndex] + 1; m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
         {
-            int currentOptionCount = -1;
+            int itemIndex = m_nodes[nodeIndex].itemIndex;
+            if (m_nodes[m_nodes[nodeIndex].upNodeIndex].downNodeIndex != nodeIndex)
+                return 0;
 
-            auto TryOption = [&](int tryOptionNodeIndex)
+            if (itemIndex < m_firstOptionalItem)
             {
-                currentOptionCount++;
+                if (m_items[m_items[itemIndex].leftItemIndex].rightItemIndex != itemIndex)
+                    return 0;
+                hasPrimaryItem = true;
+            }
+        }
+        return hasPrimaryItem ? -1 : 0;
+    }
 
-                if (SHOW_ALL_ATTEMPTS)
-                {
-                    int spacerNodeIndex = tryOptionNodeIndex;
-                    while (m_nodes[spacerNodeIndex].itemIndex != -1)
-                        spacerNodeIndex--;
+    // Compare the options taken so far against their image under each symmetry, in option order. The first option
+    // where they differ decides which is the lex leader, but only if the search can't change either of them anymore.
+    // Returns false if some symmetry turns everything below here into solutions that come first.
+    // Going deeper only ever decides more options, so the options that were already equal at the level above stay
+    // equal, and a symmetry that was already decided in our favor stays that way. Each level keeps where it got to
+    // for each symmetry, and the next level carries on from there instead of starting over at the first option.
+    bool IsSymmetryLeader(bool final)
+    {
+        size_t symmetryCount = m_symmetryInverses.size();
+        int* positions = &m_levelSymmetryPositions[size_t(m_level) * symmetryCount];
+        const int* positionsAbove = (m_level > 0 && m_levelSymmetryPositionsValid[m_level - 1]) ? positions - symmetryCount : nullptr;
+        m_levelSymmetryPositionsValid[m_level] = 0;
 
-                    int optionIndex = 0;
-                    int optionNodeIndex = spacerNodeIndex;
-                    while (optionNodeIndex != m_rootItemIndex)
-                    {
-                        optionIndex++;
-                        optionNodeIndex = m_nodes[optionNodeIndex].upNodeIndex;
-                    }
+        for (size_t symmetryIndex = 0; symmetryIndex < symmetryCount; ++symmetryIndex)
+        {
+            const std::vector<int>& inverse = m_symmetryInverses[symmetryIndex];
+            int optionIndex = positionsAbove ? positionsAbove[symmetryIndex] : 0;
+            for (; optionIndex < m_optionCount; ++optionIndex)
+            {
+                int state = OptionState(optionIndex, final);
+                if (state < 0)
+                    break;
 
-                    for (int i = 0; i < recursionCounter.s_recursionLevel; ++i)
-                        printf("  ");
-                    printf("[%i] option %i: ", currentOptionCount, optionIndex);
+                int imageState = OptionState(inverse[optionIndex], final);
+                if (imageState < 0)
+                    break;
 
-                    // Show the names of the items in this option
-                    int optionItemNodeIndex = spacerNodeIndex + 1;
-                    while (optionItemNodeIndex != spacerNodeIndex)
-                    {
-                        if (m_nodes[optionItemNodeIndex].itemIndex == -1)
-                        {
-                            optionItemNodeIndex = m_nodes[optionItemNodeIndex].upNodeIndex;
-                            continue;
-                        }
+                if (state != imageState)
+                {
+                    if (state < imageState)
+                        return false;
 
-                        printf("%s ", m_items[m_nodes[optionItemNodeIndex].itemIndex].name);
-                        optionItemNodeIndex++;
-                    }
-                    printf("\n");
+                    // Decided in our favor, for everything below here too
+                    optionIndex = m_optionCount;
+                    break;
                 }
+            }
+            positions[symmetryIndex] = optionIndex;
+        }
 
-                m_attempts++;
-                if ((m_attempts % PRINT_PROGRESS_RATE()) == 0)
-                    PrintProgress();
-
-                // Add this option onto our solution stack
-                m_solutionOptionNodeIndices.push_back(tryOptionNodeIndex);
+        // At a solution, undecided options were counted as not taken, which doesn't hold for other branches
+        m_levelSymmetryPositionsValid[m_level] = final ? 0 : 1;
+        return true;
+    }
 
-                // Cover each item from this option, except the current item
-                for (int nodeIndex = tryOptionNodeIndex + 1; nodeIndex != tryOptionNodeIndex; nodeIndex++)
+    // See SetPresolve and SetPresolveDuplicates. Returns false if there are no solutions.
+    // Each step is recorded so UndoPresolve can undo them in reverse order, mixed in with each other like they were.
+    bool Presolve()
+    {
+        bool takeOptions = !m_hasColors && !m_hasMultiplicities;
+        [[maybe_unused]] size_t duplicateCount = (!m_presolveDuplicates || m_hasMultiplicities || !m_symmetryInverses.empty()) ? 0 : PresolveDuplicates();
+        size_t forcedCount = 0;
+        size_t conflictingCount = 0;
+        int deadItemIndex = -1;
+
+        bool changed = true;
+        while (changed && deadItemIndex < 0)
+        {
+            changed = false;
+            for (int itemIndex = m_items[m_rootItemIndex].rightItemIndex; itemIndex < m_firstOptionalItem; itemIndex = m_items[itemIndex].rightItemIndex)
+            {
+                if (ItemScore(itemIndex) <= 0)
                 {
-                    if (m_nodes[nodeIndex].itemIndex == -1)
-                    {
-                        nodeIndex = m_nodes[nodeIndex].upNodeIndex;
-                        continue;
-                    }
+                    deadItemIndex = itemIndex;
+                    break;
+                }
 
-                    CoverItem(m_nodes[nodeIndex].itemIndex);
+                // Taking an option covers items, so start over after each one
+                if (takeOptions && m_items[itemIndex].optionCount == 1 && SelectOption(m_nodeOptionIndices[m_nodes[itemIndex].downNodeIndex]))
+                {
+                    m_presolveSteps.push_back({ true, m_nodeOptionIndices[m_nodes[itemIndex].downNodeIndex] });
+                    forcedCount++;
+                    changed = true;
+                    break;
                 }
+            }
 
-                // Recurse
-                SolveInternal(solutionLambda);
+            if (!changed && deadItemIndex < 0 && takeOptions)
+            {
+                size_t count = PresolveConflicting();
+                conflictingCount += count;
+                changed = count > 0;
+            }
+        }
 
-                // Uncover each item from this option, except the current item
-                for (int nodeIndex = tryOptionNodeIndex + 1; nodeIndex != tryOptionNodeIndex; nodeIndex++)
-                {
-                    if (m_nodes[nodeIndex].itemIndex == -1)
-                    {
-                        nodeIndex = m_nodes[nodeIndex].upNodeIndex;
-                        continue;
-                    }
+#if PRINT_PRESOLVE()
+        printf("Presolve took %zu forced options, and took out %zu conflicting and %zu duplicate options\n", forcedCount, conflictingCount, duplicateCount);
+        if (deadItemIndex >= 0)
+            printf("Item %s can't be covered, so there are no solutions\n", m_itemNames[deadItemIndex].name);
+#endif
+        m_presolveForcedCount = int(forcedCount);
+        return deadItemIndex < 0;
+    }
 
-                    UncoverItem(m_nodes[nodeIndex].itemIndex);
-                }
+    // Take out options with the same items and colors as an earlier option
+    size_t PresolveDuplicates()
+    {
+        size_t count = 0;
+        std::unordered_map<std::vector<uint32_t>, int, CountCacheKeyHash> optionKeys;
+        std::vector<std::pair<uint32_t, uint32_t>> itemColors;
+        for (int optionIndex = 0; optionIndex < m_optionCount; ++optionIndex)
+        {
+            if (!IsOptionAvailable(optionIndex))
+                continue;
 
-                // remove this option from our solution stack
-                m_solutionOptionNodeIndices.pop_back();
-            };
+            itemColors.clear();
+            for (int nodeIndex = m_optionNodeIndices[optionIndex] + 1; m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+                itemColors.emplace_back(uint32_t(m_nodes[nodeIndex].itemIndex), m_hasColors ? uint32_t(m_nodeColors[nodeIndex]) : 0u);
+            std::sort(itemColors.begin(), itemColors.end());
 
-            if (EXHAUSTIVE)
+            std::vector<uint32_t> key;
+            key.reserve(itemColors.size() * 2);
+            for (const auto& itemColor : itemColors)
             {
-                for (int optionNodeIndex = m_nodes[chosenItemIndex].downNodeIndex; optionNodeIndex != chosenItemIndex; optionNodeIndex = m_nodes[optionNodeIndex].downNodeIndex)
-                    TryOption(optionNodeIndex);
+                key.push_back(itemColor.first);
+                key.push_back(itemColor.second);
             }
-            else
+
+            if (optionKeys.emplace(std::move(key), optionIndex).second)
+                continue;
+
+            ExcludeOption(optionIndex);
+            m_presolveSteps.push_back({ false, optionIndex });
+            count++;
+        }
+        return count;
+    }
+
+    // Take out options that conflict with every option of some primary item. Taking one of those would leave
+    // the item with nothing to cover it. Only items with up to c_presolveMaxItemOptions options are checked, so each
+    // option is compared with a bounded number of others instead of every option of every item.
+    size_t PresolveConflicting()
+    {
+        size_t count = 0;
+        m_presolveItemMarks.resize(m_items.size(), 0);
+        for (int optionIndex = 0; optionIndex < m_optionCount; ++optionIndex)
+        {
+            if (!IsOptionAvailable(optionIndex))
+                continue;
+
+            // Mark the option's items, so other options can check for them
+            m_presolveMark++;
+            for (int nodeIndex = m_optionNodeIndices[optionIndex] + 1; m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+                m_presolveItemMarks[m_nodes[nodeIndex].itemIndex] = m_presolveMark;
+
+            for (int itemIndex = m_items[m_rootItemIndex].rightItemIndex; itemIndex < m_firstOptionalItem; itemIndex = m_items[itemIndex].rightItemIndex)
             {
-                std::vector<int> options;
-                for (int optionNodeIndex = m_nodes[chosenItemIndex].downNodeIndex; optionNodeIndex != chosenItemIndex; optionNodeIndex = m_nodes[optionNodeIndex].downNodeIndex)
-                    options.push_back(optionNodeIndex);
+                // An item with no options left means no solutions, which Presolve finds next
+                if (m_items[itemIndex].optionCount == 0)
+                    return count;
+
+                if (m_presolveItemMarks[itemIndex] == m_presolveMark || int(m_items[itemIndex].optionCount) > c_presolveMaxItemOptions)
+                    continue;
+
+                bool allConflict = true;
+                for (int itemNodeIndex = m_nodes[itemIndex].downNodeIndex; allConflict && itemNodeIndex != itemIndex; itemNodeIndex = m_nodes[itemNodeIndex].downNodeIndex)
+                {
+                    bool conflicts = false;
+                    for (int nodeIndex = m_optionNodeIndices[m_nodeOptionIndices[itemNodeIndex]] + 1; !conflicts && m_nodes[nodeIndex].itemIndex != c_spacer; ++nodeIndex)
+                        conflicts = m_presolveItemMarks[m_nodes[nodeIndex].itemIndex] == m_presolveMark;
+                    allConflict = conflicts;
+                }
 
-                std::shuffle(options.begin(), options.end(), m_rng);
-                for (int optionNodeIndex : options)
-                    TryOption(optionNodeIndex);
+                if (allConflict)
+                {
+                    ExcludeOption(optionIndex);
+                    m_presolveSteps.push_back({ false, optionIndex });
+                    count++;
+                    break;
+                }
             }
         }
+        return count;
+    }
+
+    void UndoPresolve()
+    {
+        while (!m_presolveSteps.empty())
+        {
+            if (m_presolveSteps.back().selected)
+                LeavePathLevel();
+            else
+                UnexcludeLastOption();
+            m_presolveSteps.pop_back();
+        }
+    }
 
-        // Uncover this item
-        UncoverItem(chosenItemIndex);
+    // Search only the part of the tree below the given path
+    template <typename TSolutionLambdaFN>
+    void SolveTask(const std::vector<int>& optionNumbers, const TSolutionLambdaFN& solutionLambda)
+    {
+        EnterPath(optionNumbers);
+        m_baseLevel = m_level;
+        m_searchState = SearchState::EnterLevel;
+        SolveInternal(solutionLambda);
+        m_baseLevel = 0;
+        LeavePath();
+    }
+
+    // Called at the start of each search. Search limits start counting from here too.
+    void ResetCounters()
+    {
+        m_solutionsFound = 0;
+        m_attempts = 0;
+        m_maxRecursionDepth = 0;
+        m_presolveForcedCount = 0;
+
+        m_stopReason = StopReason::None;
+        m_stopPath.clear();
+        m_searchLimitCheckCountdown = c_searchLimitCheckRate;
+        m_searchLimitAttemptsStart = 0;
+        m_breakSymmetries = !m_symmetryInverses.empty();
+        m_stats.Reset();
+        if (m_searchLimits.maxSeconds > 0.0)
+            m_deadline = std::chrono::high_resolution_clock::now() + std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(std::chrono::duration<double>(m_searchLimits.maxSeconds));
     }
 
     void CountItemOptions()
     {
         for (int itemIndex = 0; itemIndex < m_items.size() - 1; ++itemIndex)
         {
-            Item& item = m_items[itemIndex];
+            Item<TIndex>& item = m_items[itemIndex];
             item.optionCount = 0;
-            Node* itemNode = &m_nodes[itemIndex];
+            Node<TIndex>* itemNode = &m_nodes[itemIndex];
             while (itemNode->downNodeIndex != itemIndex)
             {
                 itemNode = &m_nodes[itemNode->downNodeIndex];
@@ -705,28 +3898,30 @@ private:
         // Add a node to the end to be part of the options doubly linked list.
         // This lets us simplify logic, knowing that spacer nodes are always at the start and end of every option.
         m_nodes.emplace_back();
+        m_nodeOptionIndices.push_back(-1);
+        m_nodeColors.push_back(0);
 
         int lastOptionNodeIndex = int(m_items.size() - 1); // The first spacer node
         int nextOptionNodeIndex = lastOptionNodeIndex + 1; // The first node from the first option
 
         while (true)
         {
-            while (nextOptionNodeIndex < m_nodes.size() && m_nodes[nextOptionNodeIndex].itemIndex != -1)
+            while (nextOptionNodeIndex < m_nodes.size() && m_nodes[nextOptionNodeIndex].itemIndex != c_spacer)
                 nextOptionNodeIndex++;
 
             if (nextOptionNodeIndex == m_nodes.size())
                 break;
 
-            m_nodes[lastOptionNodeIndex].downNodeIndex = nextOptionNodeIndex;
-            m_nodes[nextOptionNodeIndex].upNodeIndex = lastOptionNodeIndex;
+            m_nodes[lastOptionNodeIndex].downNodeIndex = TIndex(nextOptionNodeIndex);
+            m_nodes[nextOptionNodeIndex].upNodeIndex = TIndex(lastOptionNodeIndex);
 
             lastOptionNodeIndex = nextOptionNodeIndex;
             nextOptionNodeIndex++;
         }
 
         // Fix up the links of the first and last option to point to each other
-        m_nodes[lastOptionNodeIndex].downNodeIndex = int(m_items.size() - 1);
-        m_nodes[m_items.size() - 1].upNodeIndex = lastOptionNodeIndex;
+        m_nodes[lastOptionNodeIndex].downNodeIndex = TIndex(m_items.size() - 1);
+        m_nodes[m_items.size() - 1].upNodeIndex = TIndex(lastOptionNodeIndex);
     }
 };
 
@@ -769,11 +3964,70 @@ void BasicExamples()
         .AddOption("D,E")     // 6
         .AddOption("A,C,E,F") // 7
         .Solve([](const auto& solver) { solver.PrintSolution(); });
+
+    // Colored secondary items, like in https://www-cs-faculty.stanford.edu/~knuth/programs/dlx2.w
+    // X and Y are secondary items, which options can share if they agree on the color.
+    // 2 Solutions: A B X:0 Y:0, C Y:0 and A C X:1 Y:1, B X:1
+    Solver<true>::AddItems("A,B,C,X,Y", 3)
+        .AddOption("A,B,X:0,Y:0")
+        .AddOption("A,C,X:1,Y:1")
+        .AddOption("C,Y:0")
+        .AddOption("B,X:1")
+        .AddOption("C,Y:1")
+        .Solve([](const auto& solver) { solver.PrintSolution(); });
+
+    // Item multiplicities, like in https://www-cs-faculty.stanford.edu/~knuth/programs/dlx3.w
+    // A needs to be covered exactly twice, B exactly once, and C at most once.
+    // 2 Solutions: A B, A and A B, A C
+    Solver<true>::AddItems("2|A,B,0:1|C")
+        .AddOption("A,B")
+        .AddOption("A")
+        .AddOption("A,C")
+        .AddOption("B,C")
+        .Solve([](const auto& solver) { solver.PrintSolution(); });
+
+    // Bounds much bigger than the model. A can only be covered 3 times, so it can't be covered 99999999 times.
+    // 0 Solutions
+    Solver<true>::AddItems("A,B,C")
+        .AddOption("A,B,C")
+        .AddOption("A,B")
+        .AddOption("A,C")
+        .AddOption("B,C")
+        .AddOption("A")
+        .SetItemMultiplicity(0, 99999999, 100000000)
+        .CountSolutions();
+
+    // 4 Solutions: A B with any of the two A options
+    Solver<true>::AddItems("1:100000000|A,B")
+        .AddOption("A,B")
+        .AddOption("A")
+        .AddOption("A")
+        .CountSolutions();
+
+    // The first example again, in Knuth's text format that dlx1 reads.
+    // Secondary items come after the |, and lines starting with | are comments.
+    // 1 Unique Solution: AD, CEF, BG
+    auto textSolver = Solver<true>::FromDlxText(
+        "| This is the example from dlx1\n"
+        "A B C D E | F G\n"
+        "C E F\n"
+        "A D G\n"
+        "B C F\n"
+        "A D\n"
+        "B G\n"
+        "D E G\n"
+    );
+    textSolver.Solve([](const auto& solver) { solver.PrintSolution(); });
+
+    // Save the sealed model, and load it back ready to solve, without parsing anything
+    if (textSolver.WriteModelFile("BasicExamples.model"))
+        Solver<true>::ReadModelFile("BasicExamples.model").Solve([](const auto& solver) { solver.PrintSolution(); });
 }
 
 #include "NRooks.h"
 #include "NQueens.h"
 #include "Sudoku.h"
+#include "GridNoise.h"
 #include "PlusNoise.h"
 #include "IGN.h"
 
@@ -782,15 +4036,48 @@ int main(int argc, char** argv)
     BasicExamples();
 
     NRooks<true>(8);
+    NRooks<true>(8, true);
+
+    NRooksCount(16);
 
     NQueens<true>(8);
+    NQueens<true>(8, true);
+
+    // 16 bit indices should give the same solutions. The ZDD is made by the dancing links search, not the bitsets.
+    NQueens<true, uint16_t>(8);
+    NQueensZdd<uint16_t>(8);
+
+    NQueens<true, int, SearchStats>(6);
+
+    NQueensHeuristic<MrvHeuristic>(12, "MrvHeuristic");
+    NQueensHeuristic<MrvRandomTiesHeuristic>(12, "MrvRandomTiesHeuristic");
+    NQueensHeuristic<SharpHeuristic>(12, "SharpHeuristic");
+    NQueensHeuristic<ConflictWeightedHeuristic>(12, "ConflictWeightedHeuristic");
+
+    NQueensZdd(8);
+
+    NQueensFirstSolutions(20, 3);
+
+    NQueensEstimate(12, 10000);
+
+    NQueensCheckpoint(10, 10000);
+
+    NQueensShards(10, 3, 2);
+
+    NQueensSolutionFile(10, SolutionWriter::Format::OptionIndices);
+    NQueensSolutionFile(10, SolutionWriter::Format::BitsetDeltas);
 
     Sudoku();
 
+    SudokuBenchmark(10000, 0);
+
     PlusNoise();
 
     IGN();
 
+    GridNoise(10, 5, ".x./xxx/.x.", 1);
+    GridNoise(32, 16, "xxxx/xxxx/xxxx/xxxx", 0);
+
     //IGNRelaxed();
 
     return 0;